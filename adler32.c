@@ -0,0 +1,142 @@
+#include <pthread.h>
+
+#include "adler32.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ADLER32_X86
+#include <immintrin.h>
+#endif
+
+typedef unsigned char uchar;
+
+#define BASE 65521
+// Le plus grand nombre de bytes que l'on peut ajouter sans que s2 dépasse 32 bits (5552), arrondi à 32
+#define BLOCK_SIZE 5536
+
+typedef void (*Adler32Kernel)(unsigned* s1, unsigned* s2, const uchar* data, long length);
+static Adler32Kernel adler32Kernel;
+static const char* adler32Name;
+static pthread_once_t adler32Once = PTHREAD_ONCE_INIT;
+
+// Ajoute data à s1 et s2 (length <= BLOCK_SIZE, sans modulo)
+static void adler32Scalar(unsigned* s1, unsigned* s2, const uchar* data, long length) {
+    unsigned a = *s1, b = *s2;
+    for (long i = 0; i < length; i++) {
+        a += data[i];
+        b += a;
+    }
+    *s1 = a;
+    *s2 = b;
+}
+
+#ifdef ADLER32_X86
+/*\
+ * Pour un bloc de n bytes: s1 += somme des bytes, et s2 += n s1 + somme des (n - i) byte[i].
+ * La somme pondérée est faite par paquets de 16 (ou 32) bytes: chaque byte est multiplié par sa distance à la fin
+ * du paquet, et chaque paquet ajoute en plus 16 (ou 32) fois la somme des paquets qui le précèdent (sums).
+\*/
+__attribute__((target("sse2")))
+static unsigned horizontalSum128(__m128i x) {
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(x);
+}
+
+__attribute__((target("sse2")))
+static void adler32Sse2(unsigned* s1, unsigned* s2, const uchar* data, long length) {
+    const long packets = length / 16;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weightsLow = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+    const __m128i weightsHigh = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+    __m128i bytes = zero, sums = zero, weighted = zero;
+    for (long i = 0; i < packets; i++) {
+        const __m128i x = _mm_loadu_si128((const __m128i*) (data + 16 * i));
+        sums = _mm_add_epi32(sums, bytes);
+        bytes = _mm_add_epi32(bytes, _mm_sad_epu8(x, zero));
+        weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpacklo_epi8(x, zero), weightsLow));
+        weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpackhi_epi8(x, zero), weightsHigh));
+    }
+    *s2 += *s1 * (packets * 16) + (horizontalSum128(sums) << 4) + horizontalSum128(weighted);
+    *s1 += horizontalSum128(bytes);
+    adler32Scalar(s1, s2, data + packets * 16, length - packets * 16);
+}
+
+__attribute__((target("avx2")))
+static void adler32Avx2(unsigned* s1, unsigned* s2, const uchar* data, long length) {
+    const long packets = length / 32;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                             16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    __m256i bytes = zero, sums = zero, weighted = zero;
+    for (long i = 0; i < packets; i++) {
+        const __m256i x = _mm256_loadu_si256((const __m256i*) (data + 32 * i));
+        sums = _mm256_add_epi32(sums, bytes);
+        bytes = _mm256_add_epi32(bytes, _mm256_sad_epu8(x, zero));
+        // Les produits de deux bytes voisins tiennent sur 16 bits (255 * (32 + 31))
+        weighted = _mm256_add_epi32(weighted, _mm256_madd_epi16(_mm256_maddubs_epi16(x, weights), ones));
+    }
+    const __m128i sums128 = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    const __m128i bytes128 = _mm_add_epi32(_mm256_castsi256_si128(bytes), _mm256_extracti128_si256(bytes, 1));
+    const __m128i weighted128 = _mm_add_epi32(_mm256_castsi256_si128(weighted), _mm256_extracti128_si256(weighted, 1));
+    *s2 += *s1 * (packets * 32) + (horizontalSum128(sums128) << 5) + horizontalSum128(weighted128);
+    *s1 += horizontalSum128(bytes128);
+    adler32Scalar(s1, s2, data + packets * 32, length - packets * 32);
+}
+#endif
+
+static void initAdler32(void) {
+    adler32Kernel = adler32Scalar;
+    adler32Name = "scalar";
+#ifdef ADLER32_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        adler32Kernel = adler32Avx2;
+        adler32Name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        adler32Kernel = adler32Sse2;
+        adler32Name = "sse2";
+    }
+#endif
+}
+
+unsigned adler32Update(unsigned adler, const unsigned char* data, long length) {
+    pthread_once(&adler32Once, initAdler32);
+    unsigned s1 = adler & 0xffff, s2 = adler >> 16;
+    while (length > 0) {
+        const long block = length < BLOCK_SIZE ? length : BLOCK_SIZE;
+        adler32Kernel(&s1, &s2, data, block);
+        s1 %= BASE;
+        s2 %= BASE;
+        data += block;
+        length -= block;
+    }
+    return (s2 << 16) | s1;
+}
+
+unsigned adler32Combine(unsigned adlerA, unsigned adlerB, long lengthB) {
+    const unsigned rem = lengthB % BASE;
+    unsigned s1 = adlerA & 0xffff;
+    unsigned s2 = (rem * s1) % BASE;
+    s1 += (adlerB & 0xffff) + BASE - 1;
+    s2 += (adlerA >> 16) + (adlerB >> 16) + BASE - rem;
+    if (s1 >= BASE) s1 -= BASE;
+    if (s1 >= BASE) s1 -= BASE;
+    if (s2 >= BASE << 1) s2 -= BASE << 1;
+    if (s2 >= BASE) s2 -= BASE;
+    return (s2 << 16) | s1;
+}
+
+unsigned adler32Suffix(unsigned adlerAB, unsigned adlerA, long lengthB) {
+    // adler32Combine à l'envers: s1 = a1 + b1 - 1 et s2 = a2 + b2 + lengthB (a1 - 1), modulo BASE
+    const unsigned rem = lengthB % BASE;
+    const unsigned a1 = adlerA & 0xffff, a2 = adlerA >> 16;
+    const unsigned b1 = ((adlerAB & 0xffff) + BASE - a1 + 1) % BASE;
+    const unsigned b2 = ((adlerAB >> 16) + BASE - a2 + BASE - (rem * ((a1 + BASE - 1) % BASE)) % BASE) % BASE;
+    return (b2 << 16) | b1;
+}
+
+const char* adler32KernelName(void) {
+    pthread_once(&adler32Once, initAdler32);
+    return adler32Name;
+}
@@ -0,0 +1,21 @@
+#ifndef ADLER32_H
+#define ADLER32_H
+
+/*\
+ * L'Adler-32 des flux zlib (RFC 1950), calculé 16 bytes à la fois avec SSE2 ou 32 avec AVX2
+ * quand le processeur le permet: la version est choisie une fois, à la première utilisation.
+\*/
+
+// L'Adler-32 de data à la suite de adler (1 pour commencer)
+unsigned adler32Update(unsigned adler, const unsigned char* data, long length);
+
+// L'Adler-32 de A suivi de B (lengthB bytes), à partir de ceux de A et de B (comme adler32_combine de zlib)
+unsigned adler32Combine(unsigned adlerA, unsigned adlerB, long lengthB);
+
+// L'opération inverse: l'Adler-32 de B (lengthB bytes), à partir de ceux de A suivi de B et de A
+unsigned adler32Suffix(unsigned adlerAB, unsigned adlerA, long lengthB);
+
+// Le nom de la version utilisée
+const char* adler32KernelName(void);
+
+#endif
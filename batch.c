@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "batch.h"
+
+// Découpe la ligne en place; renvoie le nombre de champs trouvés
+static int splitLine(char* line, char** fields, int maxFields) {
+    const char* separators = strchr(line, '\t') != NULL ? "\t" : " ";
+    int count = 0;
+
+    char* field = strtok(line, separators);
+    while (field != NULL) {
+        if (count == maxFields) return maxFields + 1;
+        fields[count++] = field;
+        field = strtok(NULL, separators);
+    }
+    return count;
+}
+
+int readJobList(const char* path, int pathCount, JobList* list) {
+    list->jobs = NULL;
+    list->count = 0;
+
+    const int fromStdin = strcmp(path, "-") == 0;
+    FILE* file = fromStdin ? stdin : fopen(path, "r");
+    if (file == NULL) {
+        printf("Error in reading the batch list: %s\n", path);
+        return 1;
+    }
+
+    int capacity = 0;
+    int lineNumber = 0;
+    char line[4096];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+
+        char* fields[MAX_JOB_PATHS];
+        if (splitLine(line, fields, pathCount) != pathCount) {
+            printf("Batch list line %d: expected %d paths\n", lineNumber, pathCount);
+            if (!fromStdin) fclose(file);
+            freeJobList(list);
+            return 1;
+        }
+
+        if (list->count == capacity) {
+            capacity = capacity == 0 ? 16 : capacity * 2;
+            list->jobs = realloc(list->jobs, capacity * sizeof(Job));
+        }
+        Job* job = &list->jobs[list->count++];
+        memset(job, 0, sizeof(Job));
+        job->line = lineNumber;
+        for (int i = 0; i < pathCount; i++) job->paths[i] = strdup(fields[i]);
+    }
+
+    if (!fromStdin) fclose(file);
+    return 0;
+}
+
+void freeJobList(JobList* list) {
+    for (int i = 0; i < list->count; i++) {
+        for (int j = 0; j < MAX_JOB_PATHS; j++) free(list->jobs[i].paths[j]);
+    }
+    free(list->jobs);
+    list->jobs = NULL;
+    list->count = 0;
+}
+
+typedef struct {
+    const JobList* list;
+    JobRunner run;
+
+    pthread_mutex_t lock;
+    void** freeContexts; // Les contextes qui ne sont utilisés par aucune tâche
+    int freeContextCount;
+    int failures;
+} BatchState;
+
+typedef struct {
+    BatchState* state;
+    int index;
+} BatchTask;
+
+static void runBatchTask(void* arg) {
+    BatchTask* task = arg;
+    BatchState* state = task->state;
+    const Job* job = &state->list->jobs[task->index];
+
+    // Il y a autant de contextes que de threads, donc il en reste toujours un de libre
+    pthread_mutex_lock(&state->lock);
+    void* context = state->freeContexts[--state->freeContextCount];
+    pthread_mutex_unlock(&state->lock);
+
+    // Les messages sont gardés en mémoire pour ne pas se mélanger avec ceux des autres tâches
+    char* output = NULL;
+    size_t outputLength = 0;
+    FILE* log = open_memstream(&output, &outputLength);
+    int failed = state->run(context, job, log) != 0;
+    fclose(log);
+
+    pthread_mutex_lock(&state->lock);
+    state->freeContexts[state->freeContextCount++] = context;
+    state->failures += failed;
+    printf("=== Job %d / %d (line %d)%s ===\n", task->index + 1, state->list->count, job->line, failed ? ": failed" : "");
+    fwrite(output, 1, outputLength, stdout);
+    printf("\n");
+    fflush(stdout);
+    pthread_mutex_unlock(&state->lock);
+
+    free(output);
+}
+
+int runJobs(const JobList* list, ThreadPool* pool, JobRunner run, void** contexts) {
+    if (pool == NULL) {
+        int failures = 0;
+        for (int i = 0; i < list->count; i++) {
+            if (i > 0) printf("\n");
+            failures += run(contexts[0], &list->jobs[i], stdout) != 0;
+        }
+        return failures;
+    }
+
+    BatchState state = { .list = list, .run = run, .failures = 0 };
+    pthread_mutex_init(&state.lock, NULL);
+    state.freeContextCount = threadPoolSize(pool);
+    state.freeContexts = malloc(state.freeContextCount * sizeof(void*));
+    memcpy(state.freeContexts, contexts, state.freeContextCount * sizeof(void*));
+
+    BatchTask* tasks = malloc(list->count * sizeof(BatchTask));
+    for (int i = 0; i < list->count; i++) {
+        tasks[i] = (BatchTask) { &state, i };
+        submitTask(pool, runBatchTask, &tasks[i]);
+    }
+    waitTasks(pool);
+
+    free(tasks);
+    free(state.freeContexts);
+    pthread_mutex_destroy(&state.lock);
+    return state.failures;
+}
@@ -0,0 +1,44 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/*\
+ * Liste de tâches pour le mode batch: une tâche par ligne, avec ses chemins séparés par des tabulations
+ * (ou par des espaces si la ligne ne contient pas de tabulation).
+ * Les lignes vides et celles qui commencent par # sont ignorées.
+\*/
+
+#include <stdio.h>
+
+#include "pool.h"
+
+#define MAX_JOB_PATHS 3
+
+typedef struct {
+    char* paths[MAX_JOB_PATHS];
+    int line; // Le numéro de la ligne dans la liste, pour les messages d'erreur
+} Job;
+
+typedef struct {
+    Job* jobs;
+    int count;
+} JobList;
+
+// Lit une liste de tâches de pathCount chemins chacune (path = "-": l'entrée standard). Renvoie 0 si la liste est valide
+int readJobList(const char* path, int pathCount, JobList* list);
+void freeJobList(JobList* list);
+
+/*\
+ * Exécute une tâche avec le contexte d'un thread (ses buffers réutilisés d'une tâche à l'autre)
+ * et écrit ses messages dans log. Renvoie 0 si la tâche a réussi.
+\*/
+typedef int (*JobRunner)(void* context, const Job* job, FILE* log);
+
+/*\
+ * Exécute toutes les tâches de la liste sur les threads du pool (pool = NULL: l'une après l'autre).
+ * contexts contient un contexte par thread du pool; chaque tâche en emprunte un libre.
+ * Les messages d'une tâche sont affichés d'un bloc quand elle se termine.
+ * Renvoie le nombre de tâches qui ont échoué.
+\*/
+int runJobs(const JobList* list, ThreadPool* pool, JobRunner run, void** contexts);
+
+#endif
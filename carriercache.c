@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "carriercache.h"
+#include "sha256.h"
+
+typedef unsigned char uchar;
+
+// L'en-tête d'une entrée: la signature, puis la largeur et la hauteur (sur 4 bytes chacune, dans l'ordre de la machine)
+#define ENTRY_SIGNATURE "STEGRGB1"
+#define ENTRY_HEADER_LENGTH 16
+#define ENTRY_EXTENSION ".rgb"
+
+// Une entrée en cours d'écriture; au-delà de STALE_TEMP_AGE secondes sans être modifiée, elle a été abandonnée (processus tué...)
+#define TEMP_PREFIX ".tmp-"
+#define STALE_TEMP_AGE 3600
+
+typedef struct {
+    char* name;
+    long size;
+    struct timespec used; // la dernière utilisation
+} CachedFile;
+
+static char* joinPath(const char* directory, const char* name) {
+    const size_t length = strlen(directory) + 1 + strlen(name) + 1;
+    char* path = malloc(length);
+    if (path != NULL) snprintf(path, length, "%s/%s", directory, name);
+    return path;
+}
+
+static int isEntryName(const char* name) {
+    const size_t length = strlen(name);
+    return name[0] != '.' && length > 4 && strcmp(name + length - 4, ENTRY_EXTENSION) == 0;
+}
+
+/*\
+ * Relève les entrées du dossier dans files (à libérer avec leur nom), et leur taille totale dans totalSize.
+ * Renvoie leur nombre, ou -1 si le dossier ne peut pas être lu.
+\*/
+static int listEntries(const CarrierCache* cache, CachedFile** files, long* totalSize) {
+    DIR* dir = opendir(cache->directory);
+    if (dir == NULL) return -1;
+    int count = 0, capacity = 0;
+    *files = NULL;
+    *totalSize = 0;
+    struct dirent* dirEntry;
+    while ((dirEntry = readdir(dir)) != NULL) {
+        struct stat info;
+        if (!isEntryName(dirEntry->d_name) || fstatat(dirfd(dir), dirEntry->d_name, &info, 0) != 0) continue;
+        if (count == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            CachedFile* grown = realloc(*files, capacity * sizeof(CachedFile));
+            if (grown == NULL) break;
+            *files = grown;
+        }
+        (*files)[count++] = (CachedFile) { strdup(dirEntry->d_name), info.st_size, info.st_mtim };
+        *totalSize += info.st_size;
+    }
+    closedir(dir);
+    return count;
+}
+
+static void freeEntries(CachedFile* files, int count) {
+    for (int i = 0; i < count; i++) free(files[i].name);
+    free(files);
+}
+
+static int compareUse(const void* a, const void* b) {
+    const struct timespec* x = &((const CachedFile*) a)->used;
+    const struct timespec* y = &((const CachedFile*) b)->used;
+    if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+// Supprime les entrées temporaires abandonnées: elles ne sont pas comptées dans la taille du cache
+static void removeStaleTempFiles(const CarrierCache* cache) {
+    DIR* dir = opendir(cache->directory);
+    if (dir == NULL) return;
+    const time_t staleTime = time(NULL) - STALE_TEMP_AGE;
+    struct dirent* dirEntry;
+    while ((dirEntry = readdir(dir)) != NULL) {
+        struct stat info;
+        if (strncmp(dirEntry->d_name, TEMP_PREFIX, strlen(TEMP_PREFIX)) != 0) continue;
+        if (fstatat(dirfd(dir), dirEntry->d_name, &info, 0) == 0 && info.st_mtime < staleTime) {
+            unlinkat(dirfd(dir), dirEntry->d_name, 0);
+        }
+    }
+    closedir(dir);
+}
+
+// Supprime les entrées utilisées il y a le plus longtemps, jusqu'à ce que le cache ne dépasse plus sa taille
+static void evict(CarrierCache* cache) {
+    CachedFile* files;
+    long totalSize;
+    removeStaleTempFiles(cache);
+    const int count = listEntries(cache, &files, &totalSize);
+    if (count < 0) return;
+    if (totalSize > cache->maxSize) {
+        qsort(files, count, sizeof(CachedFile), compareUse);
+        for (int i = 0; i < count && totalSize > cache->maxSize; i++) {
+            char* path = joinPath(cache->directory, files[i].name);
+            // Une entrée projetée par une autre tâche reste lisible jusqu'à ce qu'elle la libère
+            if (path != NULL && unlink(path) == 0) {
+                totalSize -= files[i].size;
+                cache->evictions++;
+            }
+            free(path);
+        }
+    }
+    freeEntries(files, count);
+}
+
+int carrierCacheInit(CarrierCache* cache, const char* directory, long maxSize) {
+    memset(cache, 0, sizeof(CarrierCache));
+    if (mkdir(directory, 0777) != 0 && errno != EEXIST) return 1;
+    struct stat info;
+    if (stat(directory, &info) != 0 || !S_ISDIR(info.st_mode)) return 1;
+    cache->directory = strdup(directory);
+    cache->maxSize = maxSize;
+    pthread_mutex_init(&cache->lock, NULL);
+    if (cache->directory == NULL) return 1;
+    removeStaleTempFiles(cache);
+    return 0;
+}
+
+void carrierCacheFree(CarrierCache* cache) {
+    if (cache->directory == NULL) return;
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->directory);
+    cache->directory = NULL;
+}
+
+/*\
+ * Le nom de l'entrée d'une image, d'après le contenu de son fichier (sans le décoder): son SHA-256, en hexadécimal.
+ * Renvoie NULL s'il ne peut pas être lu.
+\*/
+static char* entryName(const char* imgPath) {
+    const int fd = open(imgPath, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+    madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+    uchar digest[SHA256_LENGTH];
+    sha256(mapping, info.st_size, digest);
+    munmap(mapping, info.st_size);
+
+    char* name = malloc(2 * SHA256_LENGTH + sizeof(ENTRY_EXTENSION));
+    if (name == NULL) return NULL;
+    for (int i = 0; i < SHA256_LENGTH; i++) sprintf(name + 2 * i, "%02x", digest[i]);
+    strcpy(name + 2 * SHA256_LENGTH, ENTRY_EXTENSION);
+    return name;
+}
+
+// Projette l'entrée path si c'est bien celle d'une image de width x height pixels. Renvoie 0 si elle est utilisable
+static int mapEntry(const char* path, int width, int height, CarrierEntry* entry) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return 1;
+    struct stat info;
+    const long length = ENTRY_HEADER_LENGTH + (long) width * height * 3;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size == length) mapping = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    // La date de modification est celle de la dernière utilisation, pour l'éviction
+    if (mapping != MAP_FAILED) futimens(fd, NULL);
+    close(fd);
+    if (mapping == MAP_FAILED) return 1;
+
+    const uchar* header = mapping;
+    unsigned size[2];
+    memcpy(size, header + 8, sizeof(size));
+    if (memcmp(header, ENTRY_SIGNATURE, 8) != 0 || size[0] != (unsigned) width || size[1] != (unsigned) height) {
+        munmap(mapping, length);
+        return 1;
+    }
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    entry->mapping = mapping;
+    entry->mappingLength = length;
+    entry->pixels = header + ENTRY_HEADER_LENGTH;
+    return 0;
+}
+
+int carrierCacheLookup(CarrierCache* cache, const char* imgPath, int width, int height, CarrierEntry* entry) {
+    memset(entry, 0, sizeof(CarrierEntry));
+    entry->width = width;
+    entry->height = height;
+    char* name = entryName(imgPath);
+    entry->path = name != NULL ? joinPath(cache->directory, name) : NULL;
+    free(name);
+
+    const int hit = entry->path != NULL && mapEntry(entry->path, width, height, entry) == 0;
+    pthread_mutex_lock(&cache->lock);
+    if (hit) cache->hits++;
+    else cache->misses++;
+    pthread_mutex_unlock(&cache->lock);
+    if (hit || entry->path == NULL) return !hit;
+
+    // L'entrée est écrite à côté, sous un nom temporaire, puis renommée quand elle est complète
+    entry->tempPath = joinPath(cache->directory, TEMP_PREFIX "XXXXXX");
+    const int fd = entry->tempPath != NULL ? mkstemp(entry->tempPath) : -1;
+    if (fd < 0) return 1;
+    fchmod(fd, 0644); // mkstemp ne le rend lisible que par son propriétaire
+    entry->file = fdopen(fd, "wb");
+    if (entry->file == NULL) {
+        close(fd);
+        unlink(entry->tempPath);
+        return 1;
+    }
+    uchar header[ENTRY_HEADER_LENGTH];
+    const unsigned size[2] = { width, height };
+    memcpy(header, ENTRY_SIGNATURE, 8);
+    memcpy(header + 8, size, sizeof(size));
+    entry->failed = fwrite(header, 1, ENTRY_HEADER_LENGTH, entry->file) != ENTRY_HEADER_LENGTH;
+    return 1;
+}
+
+void carrierCacheAddRow(CarrierEntry* entry, const unsigned char* row) {
+    if (entry->file == NULL || entry->failed) return;
+    const long rowLength = (long) entry->width * 3;
+    entry->failed = entry->rowCount == entry->height || fwrite(row, 1, rowLength, entry->file) != (size_t) rowLength;
+    entry->rowCount++;
+}
+
+void carrierCacheRelease(CarrierCache* cache, CarrierEntry* entry, int complete) {
+    if (entry->mapping != NULL) munmap(entry->mapping, entry->mappingLength);
+    if (entry->file != NULL) {
+        const int closed = fclose(entry->file) == 0;
+        if (complete && closed && !entry->failed && entry->rowCount == entry->height && rename(entry->tempPath, entry->path) == 0) {
+            pthread_mutex_lock(&cache->lock);
+            cache->stores++;
+            evict(cache);
+            pthread_mutex_unlock(&cache->lock);
+        } else {
+            unlink(entry->tempPath);
+        }
+    }
+    free(entry->path);
+    free(entry->tempPath);
+    memset(entry, 0, sizeof(CarrierEntry));
+}
+
+void carrierCachePrintStats(CarrierCache* cache, FILE* log) {
+    CachedFile* files;
+    long totalSize;
+    const int count = listEntries(cache, &files, &totalSize);
+    if (count >= 0) freeEntries(files, count);
+
+    fprintf(log, "Carrier cache: %ld hit%s, %ld miss%s, %ld stored, %ld evicted\n",
+            cache->hits, cache->hits == 1 ? "" : "s", cache->misses, cache->misses == 1 ? "" : "es", cache->stores, cache->evictions);
+    if (count >= 0) {
+        fprintf(log, "Cache size: %d entr%s, %.1f / %.1f MB\n", count, count == 1 ? "y" : "ies",
+                totalSize / 1048576.0, cache->maxSize / 1048576.0);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef CARRIERCACHE_H
+#define CARRIERCACHE_H
+
+/*\
+ * Cache des images décodées (option --cache), pour les services qui cachent des fichiers dans un même lot d'images:
+ * les pixels RGB de chaque image sont gardés tels quels dans un fichier du dossier du cache, projeté en mémoire
+ * avec mmap quand l'image revient, sans la décoder.
+ *
+ * Une entrée est nommée d'après le contenu du fichier de l'image (son SHA-256), pas d'après son chemin: une image
+ * modifiée ou déplacée est retrouvée ou décodée à nouveau sans rien invalider.
+ * Elle est écrite dans un fichier temporaire puis renommée: plusieurs processus peuvent partager le dossier.
+ * Un fichier temporaire abandonné (processus tué pendant l'écriture) est supprimé quand il n'a pas été modifié
+ * depuis une heure, à l'ouverture du cache et à chaque éviction.
+ * Quand la taille du cache dépasse sa limite, les entrées utilisées il y a le plus longtemps (d'après leur date
+ * de modification, mise à jour à chaque utilisation) sont supprimées.
+\*/
+
+#include <stdio.h>
+#include <pthread.h>
+
+typedef struct {
+    char* directory;
+    long maxSize; // la taille au plus de toutes les entrées, en bytes
+    pthread_mutex_t lock; // pour les statistiques et l'éviction, partagées par les threads du mode batch
+    long hits, misses, stores, evictions;
+} CarrierCache;
+
+// Une image cherchée dans le cache: soit trouvée (pixels), soit à remplir ligne par ligne pendant son décodage
+typedef struct {
+    const unsigned char* pixels; // les lignes de l'image (NULL: pas dans le cache)
+    int width, height;
+    void* mapping;
+    long mappingLength;
+    FILE* file;                  // l'entrée en cours d'écriture (NULL: rien à écrire)
+    char* path;                  // le nom définitif de l'entrée
+    char* tempPath;
+    long rowCount;
+    int failed;
+} CarrierEntry;
+
+// Crée le dossier du cache s'il n'existe pas. Renvoie 0 si le dossier peut être utilisé
+int carrierCacheInit(CarrierCache* cache, const char* directory, long maxSize);
+void carrierCacheFree(CarrierCache* cache);
+
+/*\
+ * Cherche l'image imgPath de width x height pixels. Renvoie 0 si elle est dans le cache (entry->pixels),
+ * 1 sinon: ses lignes peuvent alors être ajoutées avec carrierCacheAddRow (entry->file est NULL si l'entrée
+ * ne peut pas être créée, et les lignes sont ignorées). Dans les deux cas, carrierCacheRelease doit être appelé.
+\*/
+int carrierCacheLookup(CarrierCache* cache, const char* imgPath, int width, int height, CarrierEntry* entry);
+
+// Ajoute la ligne suivante (width * 3 bytes, en RGB) à une entrée qui n'était pas dans le cache
+void carrierCacheAddRow(CarrierEntry* entry, const unsigned char* row);
+
+// Libère entry: l'entrée remplie est ajoutée au cache si toutes ses lignes l'ont été (et si complete)
+void carrierCacheRelease(CarrierCache* cache, CarrierEntry* entry, int complete);
+
+// Affiche les statistiques des tâches, puis le nombre d'entrées et la taille du cache
+void carrierCachePrintStats(CarrierCache* cache, FILE* log);
+
+#endif
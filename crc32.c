@@ -0,0 +1,182 @@
+#include <pthread.h>
+
+#include "crc32.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_X86
+#include <immintrin.h>
+#endif
+
+typedef unsigned char uchar;
+
+#define POLYNOMIAL 0xedb88320
+
+// crcTables[k][n]: le CRC de n suivi de k bytes à 0 (crcTables[0] est la table habituelle)
+static unsigned crcTables[16][256];
+// x2nTable[n] = x^(2^n) modulo le polynôme, pour crc32Combine
+static unsigned x2nTable[32];
+
+typedef unsigned (*Crc32Kernel)(unsigned crc, const uchar* data, long length);
+static Crc32Kernel crc32Kernel;
+static const char* crc32Name;
+static pthread_once_t crc32Once = PTHREAD_ONCE_INIT;
+
+// Le produit de a et b modulo le polynôme (les bits sont inversés: x^0 est le bit 31)
+static unsigned multiplyModPolynomial(unsigned a, unsigned b) {
+    unsigned product = 0;
+    for (unsigned bit = 1u << 31; bit != 0; bit >>= 1) {
+        if (a & bit) product ^= b;
+        b = b & 1 ? (b >> 1) ^ POLYNOMIAL : b >> 1;
+    }
+    return product;
+}
+
+// x^(n * 2^k) modulo le polynôme
+static unsigned x2nModPolynomial(long n, int k) {
+    unsigned p = 1u << 31; // x^0
+    while (n > 0) {
+        if (n & 1) p = multiplyModPolynomial(x2nTable[k & 31], p);
+        n >>= 1;
+        k++;
+    }
+    return p;
+}
+
+// === Slicing-by-16 ===
+
+static unsigned crc32Bytes(unsigned crc, const uchar* data, long length) {
+    for (long i = 0; i < length; i++) crc = crcTables[0][(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+static inline unsigned loadLe32(const uchar* data) {
+    return data[0] | data[1] << 8 | data[2] << 16 | (unsigned) data[3] << 24;
+}
+
+// crc est inversé (~), comme pendant tout le calcul
+static unsigned crc32Slicing16(unsigned crc, const uchar* data, long length) {
+    while (length >= 16) {
+        crc ^= loadLe32(data);
+        // Les 16 lectures sont indépendantes: seuls les 4 premiers bytes dépendent du CRC précédent
+        const unsigned a = crcTables[15][crc & 0xff] ^ crcTables[14][(crc >> 8) & 0xff]
+                         ^ crcTables[13][(crc >> 16) & 0xff] ^ crcTables[12][crc >> 24];
+        const unsigned b = crcTables[11][data[4]] ^ crcTables[10][data[5]] ^ crcTables[9][data[6]] ^ crcTables[8][data[7]];
+        const unsigned c = crcTables[7][data[8]] ^ crcTables[6][data[9]] ^ crcTables[5][data[10]] ^ crcTables[4][data[11]];
+        const unsigned d = crcTables[3][data[12]] ^ crcTables[2][data[13]] ^ crcTables[1][data[14]] ^ crcTables[0][data[15]];
+        crc = (a ^ b) ^ (c ^ d);
+        data += 16;
+        length -= 16;
+    }
+    return crc32Bytes(crc, data, length);
+}
+
+// === Repliements avec pclmulqdq ===
+
+#ifdef CRC32_X86
+/*\
+ * 4 blocs de 16 bytes sont repliés à la fois (multipliés par x^(512 + 64) et x^512 modulo le polynôme),
+ * puis ramenés à un seul, replié 16 bytes à la fois, et enfin réduit à 32 bits (réduction de Barrett).
+ * Les constantes sont celles de l'article d'Intel "Fast CRC Computation for Generic Polynomials Using
+ * PCLMULQDQ Instruction", pour les bits inversés (comme dans zlib et Linux).
+\*/
+__attribute__((target("pclmul,sse4.1")))
+static unsigned crc32Fold(unsigned crc, const uchar* data, long length) {
+    if (length < 64) return crc32Slicing16(crc, data, length);
+
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124);
+    const __m128i barrett = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*) data), _mm_cvtsi32_si128(crc));
+    __m128i x2 = _mm_loadu_si128((const __m128i*) (data + 16));
+    __m128i x3 = _mm_loadu_si128((const __m128i*) (data + 32));
+    __m128i x4 = _mm_loadu_si128((const __m128i*) (data + 48));
+    data += 64;
+    length -= 64;
+
+    while (length >= 64) {
+        __m128i y1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        __m128i y2 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        __m128i y3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        __m128i y4 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x11), y1);
+        x2 = _mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x11), y2);
+        x3 = _mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x11), y3);
+        x4 = _mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x11), y4);
+        x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i*) data));
+        x2 = _mm_xor_si128(x2, _mm_loadu_si128((const __m128i*) (data + 16)));
+        x3 = _mm_xor_si128(x3, _mm_loadu_si128((const __m128i*) (data + 32)));
+        x4 = _mm_xor_si128(x4, _mm_loadu_si128((const __m128i*) (data + 48)));
+        data += 64;
+        length -= 64;
+    }
+
+    // Les 4 blocs sont repliés en un seul, puis les blocs de 16 bytes restants
+    __m128i next[3] = { x2, x3, x4 };
+    for (int i = 0; i < 3; i++) {
+        __m128i low = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), next[i]), low);
+    }
+    while (length >= 16) {
+        __m128i low = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_loadu_si128((const __m128i*) data)), low);
+        data += 16;
+        length -= 16;
+    }
+
+    // 128 bits vers 64 bits
+    __m128i x = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, k3k4, 0x10));
+    x = _mm_xor_si128(_mm_srli_si128(x, 4), _mm_clmulepi64_si128(_mm_and_si128(x, low32), k5, 0x00));
+
+    // Réduction de Barrett vers 32 bits
+    __m128i t = _mm_clmulepi64_si128(_mm_and_si128(x, low32), barrett, 0x10);
+    t = _mm_clmulepi64_si128(_mm_and_si128(t, low32), barrett, 0x00);
+    crc = _mm_extract_epi32(_mm_xor_si128(x, t), 1);
+
+    return crc32Slicing16(crc, data, length);
+}
+#endif
+
+// === Choix de la version ===
+
+static void initCrc32(void) {
+    for (unsigned n = 0; n < 256; n++) {
+        unsigned c = n;
+        for (int k = 0; k < 8; k++) c = c & 1 ? POLYNOMIAL ^ (c >> 1) : c >> 1;
+        crcTables[0][n] = c;
+    }
+    for (int k = 1; k < 16; k++) {
+        for (int n = 0; n < 256; n++) crcTables[k][n] = (crcTables[k - 1][n] >> 8) ^ crcTables[0][crcTables[k - 1][n] & 0xff];
+    }
+
+    x2nTable[0] = 1u << 30; // x^1
+    for (int n = 1; n < 32; n++) x2nTable[n] = multiplyModPolynomial(x2nTable[n - 1], x2nTable[n - 1]);
+
+    crc32Kernel = crc32Slicing16;
+    crc32Name = "slicing-by-16";
+#ifdef CRC32_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+        crc32Kernel = crc32Fold;
+        crc32Name = "pclmul";
+    }
+#endif
+}
+
+unsigned crc32Update(unsigned crc, const unsigned char* data, long length) {
+    pthread_once(&crc32Once, initCrc32);
+    return ~crc32Kernel(~crc, data, length);
+}
+
+unsigned crc32Combine(unsigned crcA, unsigned crcB, long lengthB) {
+    pthread_once(&crc32Once, initCrc32);
+    // Ajouter lengthB bytes à A revient à multiplier son CRC par x^(8 lengthB)
+    return multiplyModPolynomial(x2nModPolynomial(lengthB, 3), crcA) ^ crcB;
+}
+
+const char* crc32KernelName(void) {
+    pthread_once(&crc32Once, initCrc32);
+    return crc32Name;
+}
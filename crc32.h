@@ -0,0 +1,19 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+/*\
+ * Le CRC-32 des chunks png (le même que celui de zlib / gzip, polynôme 0xEDB88320).
+ * Calculé 16 bytes à la fois avec des tables (slicing-by-16), ou par repliements avec pclmulqdq
+ * quand le processeur le permet: la version est choisie une fois, à la première utilisation.
+\*/
+
+// Le CRC-32 de data à la suite de crc (0 pour commencer)
+unsigned crc32Update(unsigned crc, const unsigned char* data, long length);
+
+// Le CRC-32 de A suivi de B (lengthB bytes), à partir de ceux de A et de B
+unsigned crc32Combine(unsigned crcA, unsigned crcB, long lengthB);
+
+// Le nom de la version utilisée
+const char* crc32KernelName(void);
+
+#endif
@@ -0,0 +1,680 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "deflate.h"
+#include "adler32.h"
+
+typedef unsigned char uchar;
+typedef unsigned long long u64;
+
+#define WINDOW_SIZE 32768
+#define WINDOW_MASK (WINDOW_SIZE - 1)
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+#define NO_POS (-0x7f7f7f80)    // la valeur des têtes de chaîne vides (tous les bytes à 0x80)
+
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define TOO_FAR 4096            // une correspondance de 3 bytes plus loin que ça coûte plus cher que 3 littéraux
+
+#define BLOCK_SYMBOLS 16384     // le nombre de symboles au plus dans un bloc
+
+#define LITLEN_CODES 286
+#define DIST_CODES 30
+#define CODELEN_CODES 19
+#define MAX_CODE_LENGTH 15
+#define MAX_CODELEN_LENGTH 7
+#define END_OF_BLOCK 256
+
+// Les paramètres de zlib pour chaque niveau: au-delà de goodLength on cherche moins loin,
+// au-delà de maxLazy on ne cherche pas de meilleure correspondance au byte suivant (ou, sans lazy,
+// on n'ajoute pas toutes les positions de la correspondance aux chaînes), et niceLength suffit toujours
+typedef struct {
+    int goodLength;
+    int maxLazy;
+    int niceLength;
+    int maxChain;
+    int lazy;
+} LevelConfig;
+
+static const LevelConfig levelConfigs[10] = {
+    {  0,   0,   0,    0, 0 }, // 0: pas de compression
+    {  4,   4,   8,    4, 0 },
+    {  4,   5,  16,    8, 0 },
+    {  4,   6,  32,   32, 0 },
+    {  4,   4,  16,   16, 1 },
+    {  8,  16,  32,   32, 1 },
+    {  8,  16, 128,  128, 1 },
+    {  8,  32, 128,  256, 1 },
+    { 32, 128, 258, 1024, 1 },
+    { 32, 258, 258, 4096, 1 }, // 9: la plus forte compression
+};
+
+static const int lengthBase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const int lengthExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const int distBase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const int distExtra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+static const uchar codeLengthOrder[CODELEN_CODES] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+
+// Tables calculées une seule fois: le code de chaque longueur et distance, et les codes fixes
+static uchar lengthCodeLookup[MAX_MATCH + 1];
+static uchar distCodeLookup[512]; // distance - 1 < 256: distCodeLookup[distance - 1], sinon distCodeLookup[256 + ((distance - 1) >> 7)]
+static uchar fixedLitLengths[288];
+static unsigned short fixedLitCodes[288];
+static uchar fixedDistLengths[DIST_CODES];
+static unsigned short fixedDistCodes[DIST_CODES];
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+typedef struct {
+    unsigned short litLen; // le byte d'un littéral, ou la longueur d'une correspondance
+    unsigned short dist;   // 0 pour un littéral
+} Symbol;
+
+// Les tables de recherche, assez grosses pour être gardées d'un appel à l'autre
+struct DeflateTables {
+    int head[HASH_SIZE];   // la dernière position de chaque hash
+    int prev[WINDOW_SIZE]; // la position précédente avec le même hash, par position modulo la fenêtre
+    Symbol symbols[BLOCK_SYMBOLS];
+};
+
+typedef struct {
+    uchar* out;
+    u64 bits;     // les bits pas encore écrits, le premier dans le bit de poids faible
+    int bitCount;
+
+    DeflateTables* tables;
+    const uchar* data;
+    int blockStart;   // la position dans data du début du bloc en cours
+    int symbolCount;
+    unsigned litFreq[LITLEN_CODES];
+    unsigned distFreq[DIST_CODES];
+} Deflater;
+
+static unsigned short reverseBits(unsigned code, int length) {
+    unsigned reversed = 0;
+    for (int i = 0; i < length; i++) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+    return reversed;
+}
+
+// Les codes canoniques de Huffman, renversés puisque deflate écrit le bit de poids faible en premier
+static void buildCodes(const uchar* lengths, int count, unsigned short* codes) {
+    int lengthCount[MAX_CODE_LENGTH + 1] = { 0 };
+    int nextCode[MAX_CODE_LENGTH + 1];
+    for (int i = 0; i < count; i++) lengthCount[lengths[i]]++;
+    lengthCount[0] = 0;
+
+    int code = 0;
+    for (int length = 1; length <= MAX_CODE_LENGTH; length++) {
+        code = (code + lengthCount[length - 1]) << 1;
+        nextCode[length] = code;
+    }
+    for (int i = 0; i < count; i++) {
+        if (lengths[i] != 0) codes[i] = reverseBits(nextCode[lengths[i]]++, lengths[i]);
+    }
+}
+
+static void initTables(void) {
+    for (int code = 0; code < 29; code++) {
+        for (int i = 0; i < (1 << lengthExtra[code]); i++) lengthCodeLookup[lengthBase[code] + i] = code;
+    }
+    lengthCodeLookup[MAX_MATCH] = 28; // 258 a son propre code, pas 227 + 31
+
+    for (int code = 0; code < DIST_CODES; code++) {
+        for (int i = 0; i < (1 << distExtra[code]); i++) {
+            const int dist = distBase[code] + i - 1;
+            if (dist < 256) distCodeLookup[dist] = code;
+            else distCodeLookup[256 + (dist >> 7)] = code;
+        }
+    }
+
+    for (int i = 0; i < 288; i++) fixedLitLengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    for (int i = 0; i < DIST_CODES; i++) fixedDistLengths[i] = 5;
+    buildCodes(fixedLitLengths, 288, fixedLitCodes);
+    buildCodes(fixedDistLengths, DIST_CODES, fixedDistCodes);
+}
+
+static inline int distCode(int dist) {
+    dist--;
+    return dist < 256 ? distCodeLookup[dist] : distCodeLookup[256 + (dist >> 7)];
+}
+
+// === Écriture des bits ===
+
+static inline void putBits(Deflater* d, unsigned value, int count) {
+    d->bits |= (u64) value << d->bitCount;
+    d->bitCount += count;
+    if (d->bitCount >= 32) {
+        d->out[0] = d->bits;
+        d->out[1] = d->bits >> 8;
+        d->out[2] = d->bits >> 16;
+        d->out[3] = d->bits >> 24;
+        d->out += 4;
+        d->bits >>= 32;
+        d->bitCount -= 32;
+    }
+}
+
+// Complète le byte en cours avec des 0 et l'écrit
+static void alignToByte(Deflater* d) {
+    while (d->bitCount > 0) {
+        *d->out++ = d->bits;
+        d->bits >>= 8;
+        d->bitCount -= 8;
+    }
+    d->bits = 0;
+    d->bitCount = 0;
+}
+
+// === Codes de Huffman ===
+
+/*\
+ * Calcule en place les longueurs de code d'un code de Huffman optimal (Moffat et Katajainen):
+ * freq contient les fréquences triées par ordre croissant, et reçoit les longueurs.
+\*/
+static void minimumRedundancy(int* freq, int n) {
+    if (n == 1) {
+        freq[0] = 1;
+        return;
+    }
+
+    freq[0] += freq[1];
+    int root = 0, leaf = 2;
+    for (int next = 1; next < n - 1; next++) {
+        if (leaf >= n || freq[root] < freq[leaf]) {
+            freq[next] = freq[root];
+            freq[root++] = next;
+        } else {
+            freq[next] = freq[leaf++];
+        }
+        if (leaf >= n || (root < next && freq[root] < freq[leaf])) {
+            freq[next] += freq[root];
+            freq[root++] = next;
+        } else {
+            freq[next] += freq[leaf++];
+        }
+    }
+
+    freq[n - 2] = 0;
+    for (int next = n - 3; next >= 0; next--) freq[next] = freq[freq[next]] + 1;
+
+    int available = 1, used = 0, depth = 0;
+    root = n - 2;
+    int next = n - 1;
+    while (available > 0) {
+        while (root >= 0 && freq[root] == depth) {
+            used++;
+            root--;
+        }
+        while (available > used) {
+            freq[next--] = depth;
+            available--;
+        }
+        available = 2 * used;
+        depth++;
+        used = 0;
+    }
+}
+
+typedef struct {
+    int freq;
+    int symbol;
+} SymbolFreq;
+
+static int compareFreq(const void* a, const void* b) {
+    const SymbolFreq* x = a;
+    const SymbolFreq* y = b;
+    if (x->freq != y->freq) return x->freq < y->freq ? -1 : 1;
+    return x->symbol - y->symbol;
+}
+
+// Les longueurs de code (au plus maxLength bits) d'un code de Huffman pour ces fréquences
+static void buildLengths(const unsigned* freq, int count, int maxLength, uchar* lengths) {
+    SymbolFreq sorted[LITLEN_CODES];
+    int used = 0;
+    memset(lengths, 0, count);
+    for (int i = 0; i < count; i++) {
+        if (freq[i] != 0) sorted[used++] = (SymbolFreq) { freq[i], i };
+    }
+
+    // Un code doit avoir au moins 2 symboles pour que chacun ait au moins 1 bit
+    if (used < 2) {
+        const int symbol = used == 1 ? sorted[0].symbol : 0;
+        lengths[symbol] = 1;
+        lengths[symbol == 0 ? 1 : 0] = 1;
+        return;
+    }
+
+    qsort(sorted, used, sizeof(SymbolFreq), compareFreq);
+    int codeLengths[LITLEN_CODES];
+    for (int i = 0; i < used; i++) codeLengths[i] = sorted[i].freq;
+    minimumRedundancy(codeLengths, used);
+
+    // On ramène les codes trop longs à maxLength, puis on rallonge des codes courts
+    // jusqu'à ce que l'inégalité de Kraft soit de nouveau respectée
+    int lengthCount[32] = { 0 };
+    for (int i = 0; i < used; i++) lengthCount[codeLengths[i] > maxLength ? maxLength : codeLengths[i]]++;
+
+    unsigned total = 0;
+    for (int length = maxLength; length > 0; length--) total += (unsigned) lengthCount[length] << (maxLength - length);
+    while (total != 1u << maxLength) {
+        lengthCount[maxLength]--;
+        for (int length = maxLength - 1; length > 0; length--) {
+            if (lengthCount[length] != 0) {
+                lengthCount[length]--;
+                lengthCount[length + 1] += 2;
+                break;
+            }
+        }
+        total--;
+    }
+
+    // Les symboles les moins fréquents reçoivent les codes les plus longs
+    int i = 0;
+    for (int length = maxLength; length > 0; length--) {
+        for (int k = 0; k < lengthCount[length]; k++) lengths[sorted[i++].symbol] = length;
+    }
+}
+
+// Encode une suite de longueurs de code avec les symboles 16 (répétition), 17 et 18 (suites de 0)
+static int encodeCodeLengths(const uchar* lengths, int count, uchar* symbols, uchar* extras) {
+    int n = 0;
+    for (int i = 0; i < count;) {
+        const uchar length = lengths[i];
+        int run = 1;
+        while (i + run < count && lengths[i + run] == length) run++;
+        i += run;
+
+        if (length == 0) {
+            while (run >= 11) {
+                const int r = run < 138 ? run : 138;
+                symbols[n] = 18; extras[n++] = r - 11;
+                run -= r;
+            }
+            if (run >= 3) {
+                symbols[n] = 17; extras[n++] = run - 3;
+                run = 0;
+            }
+        } else {
+            symbols[n] = length; extras[n++] = 0;
+            run--;
+            while (run >= 3) {
+                const int r = run < 6 ? run : 6;
+                symbols[n] = 16; extras[n++] = r - 3;
+                run -= r;
+            }
+        }
+        while (run-- > 0) {
+            symbols[n] = length; extras[n++] = 0;
+        }
+    }
+    return n;
+}
+
+static const int codeLengthExtra[CODELEN_CODES] = { 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,2,3,7 };
+
+// === Blocs ===
+
+static void writeSymbols(Deflater* d, const uchar* litLengths, const unsigned short* litCodes,
+                         const uchar* distLengths, const unsigned short* distCodes) {
+    const Symbol* symbols = d->tables->symbols;
+    for (int i = 0; i < d->symbolCount; i++) {
+        const Symbol s = symbols[i];
+        if (s.dist == 0) {
+            putBits(d, litCodes[s.litLen], litLengths[s.litLen]);
+            continue;
+        }
+        const int lc = lengthCodeLookup[s.litLen];
+        putBits(d, litCodes[257 + lc] | (s.litLen - lengthBase[lc]) << litLengths[257 + lc], litLengths[257 + lc] + lengthExtra[lc]);
+        const int dc = distCode(s.dist);
+        putBits(d, distCodes[dc] | (s.dist - distBase[dc]) << distLengths[dc], distLengths[dc] + distExtra[dc]);
+    }
+    putBits(d, litCodes[END_OF_BLOCK], litLengths[END_OF_BLOCK]);
+}
+
+static void writeStored(Deflater* d, const uchar* data, int length, int final) {
+    do {
+        const int chunk = length < DEFLATE_MAX_STORED ? length : DEFLATE_MAX_STORED;
+        putBits(d, final && chunk == length, 3); // BTYPE = 00
+        alignToByte(d);
+        d->out[0] = chunk;
+        d->out[1] = chunk >> 8;
+        d->out[2] = ~chunk;
+        d->out[3] = ~chunk >> 8;
+        memcpy(d->out + 4, data, chunk);
+        d->out += 4 + chunk;
+        data += chunk;
+        length -= chunk;
+    } while (length > 0);
+}
+
+// Écrit les symboles du bloc en cours (qui couvrent data[blockStart..blockEnd[) de la façon la plus courte
+static void flushBlock(Deflater* d, int blockEnd, int final) {
+    d->litFreq[END_OF_BLOCK] = 1;
+
+    // Les bits supplémentaires des longueurs et distances ne dépendent pas du type de bloc
+    u64 extraBits = 0;
+    for (int code = 0; code < 29; code++) extraBits += (u64) d->litFreq[257 + code] * lengthExtra[code];
+    for (int code = 0; code < DIST_CODES; code++) extraBits += (u64) d->distFreq[code] * distExtra[code];
+
+    uchar litLengths[LITLEN_CODES], distLengths[DIST_CODES];
+    buildLengths(d->litFreq, LITLEN_CODES, MAX_CODE_LENGTH, litLengths);
+    buildLengths(d->distFreq, DIST_CODES, MAX_CODE_LENGTH, distLengths);
+
+    int litCount = LITLEN_CODES, distCount = DIST_CODES;
+    while (litCount > 257 && litLengths[litCount - 1] == 0) litCount--;
+    while (distCount > 1 && distLengths[distCount - 1] == 0) distCount--;
+
+    uchar allLengths[LITLEN_CODES + DIST_CODES];
+    memcpy(allLengths, litLengths, litCount);
+    memcpy(allLengths + litCount, distLengths, distCount);
+    uchar clSymbols[LITLEN_CODES + DIST_CODES], clExtras[LITLEN_CODES + DIST_CODES];
+    const int clCount = encodeCodeLengths(allLengths, litCount + distCount, clSymbols, clExtras);
+
+    unsigned clFreq[CODELEN_CODES] = { 0 };
+    for (int i = 0; i < clCount; i++) clFreq[clSymbols[i]]++;
+    uchar clLengths[CODELEN_CODES];
+    buildLengths(clFreq, CODELEN_CODES, MAX_CODELEN_LENGTH, clLengths);
+    int clOrderCount = CODELEN_CODES;
+    while (clOrderCount > 4 && clLengths[codeLengthOrder[clOrderCount - 1]] == 0) clOrderCount--;
+
+    // La taille en bits de chaque type de bloc
+    u64 dynamicBits = 3 + 5 + 5 + 4 + 3 * clOrderCount + extraBits;
+    for (int i = 0; i < CODELEN_CODES; i++) dynamicBits += (u64) clFreq[i] * (clLengths[i] + codeLengthExtra[i]);
+    u64 fixedBits = 3 + extraBits;
+    for (int i = 0; i < LITLEN_CODES; i++) {
+        dynamicBits += (u64) d->litFreq[i] * litLengths[i];
+        fixedBits += (u64) d->litFreq[i] * fixedLitLengths[i];
+    }
+    for (int i = 0; i < DIST_CODES; i++) {
+        dynamicBits += (u64) d->distFreq[i] * distLengths[i];
+        fixedBits += (u64) d->distFreq[i] * fixedDistLengths[i];
+    }
+    const int blockLength = blockEnd - d->blockStart;
+    const u64 storedBits = (u64) ((blockLength + DEFLATE_MAX_STORED - 1) / DEFLATE_MAX_STORED + 1) * (3 + 7 + 32) + (u64) blockLength * 8;
+
+    if (storedBits <= dynamicBits && storedBits <= fixedBits) {
+        writeStored(d, d->data + d->blockStart, blockLength, final);
+    } else if (fixedBits <= dynamicBits) {
+        putBits(d, final | 1 << 1, 3); // BTYPE = 01
+        writeSymbols(d, fixedLitLengths, fixedLitCodes, fixedDistLengths, fixedDistCodes);
+    } else {
+        putBits(d, final | 2 << 1, 3); // BTYPE = 10
+        putBits(d, litCount - 257, 5);
+        putBits(d, distCount - 1, 5);
+        putBits(d, clOrderCount - 4, 4);
+        for (int i = 0; i < clOrderCount; i++) putBits(d, clLengths[codeLengthOrder[i]], 3);
+
+        unsigned short clCodes[CODELEN_CODES], litCodes[LITLEN_CODES], distCodes[DIST_CODES];
+        buildCodes(clLengths, CODELEN_CODES, clCodes);
+        buildCodes(litLengths, LITLEN_CODES, litCodes);
+        buildCodes(distLengths, DIST_CODES, distCodes);
+        for (int i = 0; i < clCount; i++) {
+            const int symbol = clSymbols[i];
+            putBits(d, clCodes[symbol] | clExtras[i] << clLengths[symbol], clLengths[symbol] + codeLengthExtra[symbol]);
+        }
+        writeSymbols(d, litLengths, litCodes, distLengths, distCodes);
+    }
+
+    d->blockStart = blockEnd;
+    d->symbolCount = 0;
+    memset(d->litFreq, 0, sizeof(d->litFreq));
+    memset(d->distFreq, 0, sizeof(d->distFreq));
+}
+
+static inline void emitLiteral(Deflater* d, uchar byte) {
+    d->tables->symbols[d->symbolCount++] = (Symbol) { byte, 0 };
+    d->litFreq[byte]++;
+}
+
+static inline void emitMatch(Deflater* d, int length, int dist) {
+    d->tables->symbols[d->symbolCount++] = (Symbol) { length, dist };
+    d->litFreq[257 + lengthCodeLookup[length]]++;
+    d->distFreq[distCode(dist)]++;
+}
+
+// === Recherche des correspondances ===
+
+static inline unsigned hash3(const uchar* p) {
+    unsigned value;
+    memcpy(&value, p, 4); // on lit 4 bytes mais seuls les 3 premiers comptent
+    return ((value & 0xffffff) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Ajoute la position aux chaînes (il faut 4 bytes lisibles à partir de pos) et renvoie la précédente avec le même hash
+static inline int insertString(DeflateTables* tables, const uchar* data, int pos) {
+    const unsigned h = hash3(data + pos);
+    const int head = tables->head[h];
+    tables->prev[pos & WINDOW_MASK] = head;
+    tables->head[h] = pos;
+    return head;
+}
+
+static inline int matchLength(const uchar* a, const uchar* b, int maxLength) {
+    int length = 0;
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // 8 bytes à la fois: le premier byte différent est donné par le premier bit à 1 de a ^ b
+    while (length + 8 <= maxLength) {
+        u64 x, y;
+        memcpy(&x, a + length, 8);
+        memcpy(&y, b + length, 8);
+        if (x != y) return length + (__builtin_ctzll(x ^ y) >> 3);
+        length += 8;
+    }
+#endif
+    while (length < maxLength && a[length] == b[length]) length++;
+    return length;
+}
+
+// Cherche dans la chaîne de pos une correspondance plus longue que bestLength; renvoie sa longueur
+static int longestMatch(Deflater* d, int pos, int end, int candidate, int bestLength, int chain, int niceLength, int* matchPos) {
+    const uchar* data = d->data;
+    const int* prev = d->tables->prev;
+    const int limit = pos - WINDOW_SIZE;
+    const int maxLength = end - pos < MAX_MATCH ? end - pos : MAX_MATCH;
+    if (bestLength >= maxLength) return bestLength;
+
+    while (candidate > limit && chain-- > 0) {
+        const uchar* match = data + candidate;
+        // On vérifie d'abord le byte qui ferait une correspondance plus longue
+        if (match[bestLength] == data[pos + bestLength] && match[0] == data[pos]) {
+            const int length = matchLength(match, data + pos, maxLength);
+            if (length > bestLength) {
+                bestLength = length;
+                *matchPos = candidate;
+                if (length >= niceLength || length == maxLength) break;
+            }
+        }
+        candidate = prev[candidate & WINDOW_MASK];
+    }
+    return bestLength;
+}
+
+// Niveaux 1 à 3: chaque correspondance trouvée est prise tout de suite
+static void compressGreedy(Deflater* d, int start, int end, const LevelConfig* config) {
+    const uchar* data = d->data;
+    int pos = start;
+    while (pos < end) {
+        int length = 0, matchPos = 0;
+        if (pos + 4 <= end) {
+            const int candidate = insertString(d->tables, data, pos);
+            length = longestMatch(d, pos, end, candidate, MIN_MATCH - 1, config->maxChain, config->niceLength, &matchPos);
+        }
+
+        if (length >= MIN_MATCH && !(length == MIN_MATCH && pos - matchPos > TOO_FAR)) {
+            emitMatch(d, length, pos - matchPos);
+            // Les longues correspondances ne sont pas ajoutées aux chaînes, pour aller plus vite
+            if (length <= config->maxLazy) {
+                for (int p = pos + 1; p < pos + length && p + 4 <= end; p++) insertString(d->tables, data, p);
+            }
+            pos += length;
+        } else {
+            emitLiteral(d, data[pos]);
+            pos++;
+        }
+
+        if (d->symbolCount == BLOCK_SYMBOLS) flushBlock(d, pos, 0);
+    }
+}
+
+// Niveaux 4 à 9: avant de prendre une correspondance, on regarde si le byte suivant en donne une plus longue
+static void compressLazy(Deflater* d, int start, int end, const LevelConfig* config) {
+    const uchar* data = d->data;
+    int pos = start;
+    int prevLength = MIN_MATCH - 1, prevMatch = 0;
+    int matchAvailable = 0; // le byte pos - 1 attend de savoir s'il commence une correspondance
+    while (pos < end) {
+        int length = MIN_MATCH - 1, matchPos = 0;
+        if (pos + 4 <= end) {
+            const int candidate = insertString(d->tables, data, pos);
+            if (prevLength < config->maxLazy) {
+                const int chain = prevLength >= config->goodLength ? config->maxChain >> 2 : config->maxChain;
+                length = longestMatch(d, pos, end, candidate, prevLength, chain, config->niceLength, &matchPos);
+                if (length == prevLength) length = MIN_MATCH - 1; // rien de plus long que la correspondance précédente
+                if (length == MIN_MATCH && pos - matchPos > TOO_FAR) length = MIN_MATCH - 1;
+            }
+        }
+
+        int covered = -1; // la fin des bytes couverts par un symbole émis à ce tour
+        if (prevLength >= MIN_MATCH && length <= prevLength) {
+            // La correspondance qui commence à pos - 1 est la meilleure
+            emitMatch(d, prevLength, pos - 1 - prevMatch);
+            covered = pos - 1 + prevLength;
+            for (int p = pos + 1; p < covered && p + 4 <= end; p++) insertString(d->tables, data, p);
+            pos = covered;
+            matchAvailable = 0;
+            prevLength = MIN_MATCH - 1;
+        } else {
+            if (matchAvailable) {
+                emitLiteral(d, data[pos - 1]);
+                covered = pos;
+            }
+            matchAvailable = 1;
+            prevLength = length;
+            prevMatch = matchPos;
+            pos++;
+        }
+
+        if (d->symbolCount == BLOCK_SYMBOLS) flushBlock(d, covered, 0);
+    }
+    if (matchAvailable) emitLiteral(d, data[end - 1]);
+}
+
+/*\
+ * Compresse data[start..end[ en un ou plusieurs blocs. Les 32 Ko avant start servent de dictionnaire:
+ * les correspondances peuvent y remonter. Si final est à 0, les blocs sont suivis d'un bloc vide
+ * sans compression (sync flush) pour finir sur un byte entier, et le flux peut continuer ailleurs.
+\*/
+static void compressRange(Deflater* d, int start, int end, const LevelConfig* config, int final) {
+    memset(d->tables->head, 0x80, sizeof(d->tables->head)); // NO_POS partout
+    const int dictionaryStart = start > WINDOW_SIZE ? start - WINDOW_SIZE : 0;
+    for (int p = dictionaryStart; p < start && p + 4 <= end; p++) insertString(d->tables, d->data, p);
+
+    d->blockStart = start;
+    if (config->lazy) compressLazy(d, start, end, config);
+    else compressGreedy(d, start, end, config);
+    flushBlock(d, end, final);
+
+    if (!final) {
+        putBits(d, 0, 3); // BFINAL = 0, BTYPE = 00
+        alignToByte(d);
+        memcpy(d->out, "\x00\x00\xff\xff", 4); // LEN = 0, NLEN = ~0
+        d->out += 4;
+    } else {
+        alignToByte(d);
+    }
+}
+
+// === Compression ===
+
+// La taille au plus des blocs qui compressent length bytes: au pire chacun est écrit sans compression,
+// et un bloc se termine au plus tôt après BLOCK_SYMBOLS bytes
+static long compressBound(int length) {
+    const long blockCount = length / BLOCK_SYMBOLS + 1;
+    return length + (2 * blockCount + length / DEFLATE_MAX_STORED + 1) * 6;
+}
+
+// === Compression par morceaux ===
+
+DeflateTables* deflateNewTables(void) {
+    return malloc(sizeof(DeflateTables));
+}
+
+void deflateDeleteTables(DeflateTables* tables) {
+    free(tables);
+}
+
+int deflateHeader(int level, unsigned char* out) {
+    // Fenêtre de 32 Ko et FLEVEL selon le niveau
+    out[0] = 0x78;
+    out[1] = level <= 1 ? 0x01 : level <= 5 ? 0x5e : level == 6 ? 0x9c : 0xda;
+    return 2;
+}
+
+void deflateStoredHeader(int length, int final, unsigned char* out) {
+    out[0] = final != 0; // BFINAL, BTYPE = 00, puis le byte est complété par des 0
+    out[1] = length;
+    out[2] = length >> 8;
+    out[3] = ~length;
+    out[4] = ~length >> 8;
+}
+
+/*\
+ * Un bloc vide à codes fixes fait 10 bits (3 d'en-tête et le code 7 bits de la fin de bloc): avec 0 à 3, on atteint les bits pairs.
+ * Pour les bits impairs, on commence par un bloc vide à codes dynamiques de 97 bits: deux littéraux (0 et la fin de bloc)
+ * de 1 bit et aucune distance, avec les 19 longueurs de codes des longueurs (3 bits chacune).
+\*/
+int deflateEmptyBlocks(int bit, unsigned char* out, unsigned char* partial) {
+    Deflater d = { .out = out };
+    int fixedCount = bit / 2;
+    if (bit % 2 == 1) {
+        putBits(&d, 2 << 1, 3); // BTYPE = 10
+        putBits(&d, 0, 5);      // 257 littéraux / longueurs
+        putBits(&d, 0, 5);      // 1 distance
+        putBits(&d, CODELEN_CODES - 4, 4);
+        // Les longueurs de codes des longueurs: 18 (suite de 0) sur 1 bit, 0 et 1 sur 2 bits
+        for (int i = 0; i < CODELEN_CODES; i++) {
+            const int code = codeLengthOrder[i];
+            putBits(&d, code == 18 ? 1 : code <= 1 ? 2 : 0, 3);
+        }
+        // Les longueurs: 1 pour le littéral 0, 255 fois 0 (138 + 117 avec le code 18), 1 pour la fin de bloc, 0 pour la distance.
+        // Les codes sont 18 = 0, 0 = 10 et 1 = 11, écrits à l'envers
+        putBits(&d, 3, 2);
+        putBits(&d, 0 | (138 - 11) << 1, 1 + 7);
+        putBits(&d, 0 | (117 - 11) << 1, 1 + 7);
+        putBits(&d, 3, 2);
+        putBits(&d, 1, 2);
+        putBits(&d, 1, 1); // la fin de bloc (le littéral 0 est le code 0)
+        fixedCount = (bit - 1) / 2;
+    }
+    for (int i = 0; i < fixedCount; i++) putBits(&d, 1 << 1, 3 + 7); // BTYPE = 01, puis la fin de bloc (0000000)
+    while (d.bitCount >= 8) {
+        *d.out++ = d.bits;
+        d.bits >>= 8;
+        d.bitCount -= 8;
+    }
+    *partial = d.bits;
+    return d.out - out;
+}
+
+long deflateChunkBound(int length) {
+    return compressBound(length) + 5;
+}
+
+int deflateChunk(DeflateTables* tables, const unsigned char* data, int dictionaryLength, int length,
+                 int level, int final, unsigned char* out, unsigned* adler) {
+    pthread_once(&tablesOnce, initTables);
+    if (level > 9) level = 9;
+
+    // Les positions sont comptées depuis le début du dictionnaire
+    Deflater d = { .out = out, .data = data - dictionaryLength, .tables = tables };
+    if (level <= 0) writeStored(&d, data, length, final); // les blocs sans compression finissent sur un byte entier
+    else compressRange(&d, dictionaryLength, dictionaryLength + length, &levelConfigs[level], final);
+
+    *adler = adler32Update(1, data, length);
+    return d.out - out;
+}
+
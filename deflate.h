@@ -0,0 +1,51 @@
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+/*\
+ * Compression zlib (RFC 1950/1951) utilisée par PngWriter, morceau par morceau pour ne pas avoir toutes les données en mémoire.
+ *
+ * Les correspondances sont cherchées dans des chaînes de hash sur une fenêtre de 32 Ko, et chaque bloc
+ * est écrit avec des codes de Huffman dynamiques, fixes ou sans compression, selon le plus court.
+ * level va de 0 (pas de compression, le plus rapide) à 9 (la plus forte compression), comme zlib.
+ *
+ * Chaque morceau est compressé avec les 32 Ko (au plus) qui le précèdent comme dictionnaire et se termine
+ * sur un byte entier: les morceaux peuvent être compressés sur des threads différents puis mis bout à bout.
+ * Le flux est l'en-tête (deflateHeader), les morceaux, puis l'Adler-32 de toutes les données (big endian),
+ * que l'on obtient en combinant ceux des morceaux (adler32Combine).
+\*/
+typedef struct DeflateTables DeflateTables;
+
+// Les tables de recherche d'une compression par morceaux: une par morceau compressé en même temps, gardées d'un flux à l'autre
+DeflateTables* deflateNewTables(void);
+void deflateDeleteTables(DeflateTables* tables);
+
+// Écrit les 2 bytes de l'en-tête zlib dans out; renvoie leur nombre
+int deflateHeader(int level, unsigned char* out);
+
+// La taille au plus d'un morceau de length bytes une fois compressé
+long deflateChunkBound(int length);
+
+/*\
+ * Sans compression (niveau 0), les données peuvent être écrites telles quelles, sans copie, dans des blocs
+ * d'au plus DEFLATE_MAX_STORED bytes: chacun commence par les 5 bytes écrits par deflateStoredHeader.
+ * Comme les autres morceaux, une suite de blocs finit sur un byte entier.
+\*/
+#define DEFLATE_MAX_STORED 65535
+void deflateStoredHeader(int length, int final, unsigned char* out);
+
+/*\
+ * Des blocs vides qui commencent sur un byte entier et se terminent au bit numéro bit (0 à 7) d'un byte,
+ * pour continuer avec un bloc d'un autre flux qui ne commence pas sur un byte entier (voir pngsplice.h).
+ * Les bytes complets (16 au plus) sont écrits dans out, et leur nombre renvoyé; les bit premiers bits
+ * (de poids faible) du byte suivant sont dans *partial.
+\*/
+int deflateEmptyBlocks(int bit, unsigned char* out, unsigned char* partial);
+
+/*\
+ * Compresse data[0..length[ dans out, avec les dictionaryLength bytes avant data comme dictionnaire.
+ * final: le dernier morceau du flux. Renvoie le nombre de bytes écrits et l'Adler-32 du morceau dans adler.
+\*/
+int deflateChunk(DeflateTables* tables, const unsigned char* data, int dictionaryLength, int length,
+                 int level, int final, unsigned char* out, unsigned* adler);
+
+#endif
@@ -1,29 +1,58 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "stb_image.h"
-#include "stb_image_write.h"
+
+#include "kernels.h"
+#include "pngcheck.h"
+#include "batch.h"
+#include "pngwrite.h"
+#include "rawwrite.h"
+#include "pngsplice.h"
+#include "carriercache.h"
 
 #define COLOR "\e[38;5;4m" // Blue
 #define RESET "\e[m"
 
 #define USED_CHANNELS 3
 
-#define IMG_PATH "files/clouds.png"
-#define FILE_PATH "files/landscape.png"
-#define OUTPUT_PATH "output/out.png"
+// Les tailles et positions sont des long: il leur faut 64 bits (le prefix fait sizeof(long) bytes)
+_Static_assert(sizeof(long) == 8, "long must be 64-bit");
 
 /*\
- * Modes disponibles:
+ * Modes disponibles (option -m):
  * 0: utilisation de 1 bit par composant de pixel (pratiquement indétectable)
  * 1: utilisation de 2 bit par composant de pixel (difficilement visible)
  * 2: utilisation de 4 bit par composant de pixel (très visible)
  * 3: utilisation de 8 bit par composant de pixel (l'image d'origine est complètement écrasée)
 \*/
-#define BYTE_CHUNK_SIZE_MODE 2
+#define DEFAULT_BYTE_CHUNK_SIZE_MODE 2
+
+// Mode auto (option -m auto): le plus petit mode dans lequel le fichier tient dans l'image
+#define AUTO_BYTE_CHUNK_SIZE_MODE 255
+
+// Niveau de compression du png (option -z), de 0 (pas de compression) à 9 (la plus forte, mais très lente)
+#define DEFAULT_COMPRESSION_LEVEL 4
 
-typedef unsigned char uchar;
+// La taille au plus du cache des images décodées (option --cache-size), en Mo
+#define DEFAULT_CACHE_SIZE 1024
+
+/*\
+ * Avec plusieurs threads, les lignes qui reçoivent des bytes cachés sont rassemblées en bandes d'environ
+ * EMBED_BAND_SIZE composants, et chaque bande est découpée en tranches cachées en même temps sur le pool.
+ * Les tranches commencent sur un byte caché multiple de CACHE_LINE, placé au début d'une ligne de cache de la bande:
+ * deux threads n'écrivent jamais dans la même ligne de cache. En dessous de MIN_SLICE_LENGTH bytes cachés par tranche,
+ * la synchronisation coûte plus qu'elle ne rapporte.
+\*/
+#define EMBED_BAND_SIZE (4 * 1024 * 1024)
+#define CACHE_LINE 64
+#define MIN_SLICE_LENGTH (16 * 1024)
 
 uchar getBitAt(uchar byte, uchar index) {
     return (byte >> index) & 1;
@@ -36,140 +65,741 @@ void setBitAt(uchar* byte, uchar index, uchar bit) {
     *byte |= bit << index;
 }
 
-void writeBufferToImg(uchar* img, uchar* buffer, const long bufferLength, const uchar byteChunkSize) {
-    const uchar lastBitsMask = 
-        byteChunkSize == 8 ? 0b11111111 : 
-        byteChunkSize == 4 ? 0b00001111 : 
-        byteChunkSize == 2 ? 0b00000011 : 
-        byteChunkSize == 1 ? 0b00000001 : 0;
-
-    // Le nombre de byteChunk = le nombre de bytes multiplié par le nombre de byteChunk dans 1 byte
-    const long byteChunkCount = bufferLength * (8 / byteChunkSize);
-
-    long bufferIndex = 0;
-    uchar bytePos = 0;
-    for (long imageIndex = 0; imageIndex < byteChunkCount; imageIndex++) {
-
-        // On lit le byte courant du buffer
-        uchar byte = buffer[bufferIndex];
-        // On décale le byteChunk pour qu'il soit positionné au début du byte
-        uchar byteChunk = byte >> (8 - bytePos - byteChunkSize);
-        // On met à 0 les éventuels bits qui sont à gauche du byteChunk
-        byteChunk &= lastBitsMask;
-
-        // On incrémente la position du byteChunk dans le byte
-        bytePos += byteChunkSize;
-        // Si bytePos est à 8, on passe au prochain byte
-        if (bytePos == 8) {
-            bytePos = 0;
-            bufferIndex++;
+// Ce qui est gardé d'une tâche à l'autre par un thread
+typedef struct {
+    ThreadPool* pool;     // Le pool qui cache les bandes de lignes et compresse le png (NULL: le thread courant)
+    uchar* buffer;        // Le buffer du fichier quand il ne peut pas être projeté en mémoire, agrandi au besoin
+    long bufferCapacity;
+    PngTables tables;     // Les tables de compression prêtées au PngWriter de chaque tâche
+    uchar byteChunkSizeMode;
+    int compressionLevel;
+    PngFilters filters;
+    int syntheticWidth, syntheticHeight; // Option --synthetic: l'image est générée au lieu d'être lue (0: pas d'image générée)
+    int shouldSplice;     // Ne réencoder que les lignes modifiées d'un png (voir pngsplice.h)
+    CarrierCache* cache;  // Option --cache: les images décodées sont gardées sur le disque (NULL: pas de cache)
+} EncodeContext;
+
+// Le contenu du fichier à cacher
+typedef struct {
+    const uchar* bytes;
+    long length;
+    void* mapping; // La projection du fichier en mémoire (NULL: le fichier a été lu dans le buffer du contexte)
+} Payload;
+
+/*\
+ * Projette le fichier en mémoire avec mmap: ses pages sont lues depuis le cache du système au fur
+ * et à mesure de l'écriture dans l'image, sans copie. Si ce n'est pas possible (fichier vide, pipe...),
+ * le fichier est lu dans le buffer du contexte. Renvoie 0 si tout s'est bien passé.
+\*/
+static int openPayload(EncodeContext* context, const char* filePath, Payload* payload) {
+    payload->mapping = NULL;
+
+    const int fd = open(filePath, O_RDONLY);
+    if (fd < 0) return 1;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            // Le fichier est parcouru du début à la fin: le système peut lire en avance et libérer derrière
+            madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+            close(fd);
+            payload->bytes = mapping;
+            payload->length = info.st_size;
+            payload->mapping = mapping;
+            return 0;
         }
+    }
 
-        // le byte correspondant à la valeur du composant de pixel
-        uchar imageByte = img[imageIndex];
-        // On met à zéro les derniers bits du byte avec le mask
-        imageByte &= ~lastBitsMask;
-        // On ajoute le byteChunk à la place des bits qui ont été mis à zéro
-        // (on est assurés que byteChunk ne dépasse pas le nombre de bits de byteChunkSize
-        imageByte |= byteChunk;
-        // On réassigne le nouveau byte modifié à l'image
-        img[imageIndex] = imageByte;
+    // Lecture classique, par morceaux puisque la taille n'est pas forcément connue à l'avance
+    long length = 0;
+    for (;;) {
+        if (context->bufferCapacity == length) {
+            const long capacity = context->bufferCapacity == 0 ? 64 * 1024 : context->bufferCapacity * 2;
+            uchar* buffer = realloc(context->buffer, capacity);
+            if (buffer == NULL) {
+                close(fd);
+                return 1;
+            }
+            context->buffer = buffer;
+            context->bufferCapacity = capacity;
+        }
+        const ssize_t count = read(fd, context->buffer + length, context->bufferCapacity - length);
+        if (count < 0) {
+            close(fd);
+            return 1;
+        }
+        if (count == 0) break;
+        length += count;
     }
+    close(fd);
+    payload->bytes = context->buffer;
+    payload->length = length;
+    return 0;
 }
 
-int main() {
-    const uchar byteChunkSize = pow(2, BYTE_CHUNK_SIZE_MODE);
-    if (8 % byteChunkSize != 0) {
-        printf("Byte chunk size must be a divisor of 8, but found %d\n", byteChunkSize);
-        return 1;
+static void closePayload(Payload* payload) {
+    if (payload->mapping != NULL) munmap(payload->mapping, payload->length);
+}
+
+// L'écriture de l'image ligne par ligne: chaque ligne reçoit ses byteChunk puis part dans le png (ou le BMP, TGA, PPM)
+typedef struct {
+    PngWriter* writer;
+    RawWriter* rawWriter;     // Sortie sans compression, choisie par l'extension (NULL: png)
+    CarrierEntry* cacheEntry; // L'entrée du cache remplie avec les lignes de l'image, avant qu'elles soient modifiées
+    ThreadPool* pool;         // Le pool qui cache les tranches d'une bande (partagé avec le PngWriter)
+    long rowLength;           // Le nombre de composants de pixel dans une ligne
+    uchar byteChunkSizeMode;
+    uchar byteChunkSize;
+    EmbedKernel embed;        // Le noyau spécialisé pour le mode
+    uchar prefix[sizeof(long)];
+    const uchar* file;
+    long filelen;
+    long hiddenEnd;           // La fin des composants qui reçoivent le mode et des bytes cachés
+    uchar* band;              // Les lignes de la bande en cours (NULL: chaque ligne est traitée dès qu'elle arrive)
+    uchar* bandComps;         // Le premier composant de la bande, dans band (voir EMBED_BAND_SIZE)
+    int bandCapacity;         // Le nombre de lignes au plus d'une bande
+    int bandFirstRow;
+    int bandRows;
+    struct EmbedSlice* slices; // Une tranche par thread du pool
+    int rowCount;             // Les lignes déjà reçues
+    int failed;
+} RowEncoder;
+
+// Les composants [first, first + count[ de l'image, qui commencent à comps dans la bande
+typedef struct EmbedSlice {
+    const RowEncoder* encoder;
+    uchar* comps;
+    long first, count;
+} EmbedSlice;
+
+// Le byte numéro index parmi les bytes à cacher: le prefix, puis le fichier
+static uchar hiddenByte(const RowEncoder* encoder, long index) {
+    return index < (long) sizeof(encoder->prefix) ? encoder->prefix[index] : encoder->file[index - sizeof(encoder->prefix)];
+}
+
+/*\
+ * Ecrit les byteChunk [a, b[ du byte numéro index, quand le byte est à cheval sur deux morceaux de l'image.
+ * comps contient les composants à partir du numéro first.
+\*/
+static void writePartialByte(const RowEncoder* encoder, uchar* comps, long first, long index, long a, long b) {
+    const long chunksPerByte = 8 / encoder->byteChunkSize;
+    const long start = index * chunksPerByte;
+
+    // On écrit le byte en entier dans une copie des composants, puis on ne garde que ceux du morceau
+    uchar chunks[8] = { 0 };
+    for (long i = a; i < b; i++) chunks[i - start] = comps[2 + i - first];
+    const uchar byte = hiddenByte(encoder, index);
+    writeBufferToImgScalar(chunks, &byte, 1, encoder->byteChunkSize);
+    for (long i = a; i < b; i++) comps[2 + i - first] = chunks[i - start];
+}
+
+// Ecrit dans comps, les composants [first, first + count[ de l'image, le byteChunkSizeMode et les byteChunk qui y tombent
+static void embedComponents(const RowEncoder* encoder, uchar* comps, long first, long count) {
+    const long end = first + count;
+    const uchar byteChunkSize = encoder->byteChunkSize;
+
+    // Les 2 premiers composants sont réservés pour byteChunkSizeMode
+    for (long i = first; i < 2 && i < end; i++) setBitAt(comps + i - first, 0, getBitAt(encoder->byteChunkSizeMode, i));
+
+    // Les byteChunk numéro [a, b[ tombent dans ce morceau de l'image
+    const long chunksPerByte = 8 / byteChunkSize;
+    const long hiddenChunks = (sizeof(encoder->prefix) + encoder->filelen) * chunksPerByte;
+    const long a = first > 2 ? first - 2 : 0;
+    const long b = end - 2 < hiddenChunks ? end - 2 : hiddenChunks;
+    if (a >= b) return;
+
+    // Les bytes [firstByte, endByte[ tombent en entier dans le morceau
+    const long firstByte = (a + chunksPerByte - 1) / chunksPerByte;
+    const long endByte = b / chunksPerByte;
+    if (firstByte > endByte) {
+        writePartialByte(encoder, comps, first, endByte, a, b);
+        return;
     }
+    if (a % chunksPerByte != 0) writePartialByte(encoder, comps, first, firstByte - 1, a, firstByte * chunksPerByte);
 
-    printf("Byte chunk size: %d bit\n", byteChunkSize);
+    long index = firstByte;
+    if (index < (long) sizeof(encoder->prefix) && index < endByte) {
+        const long prefixEnd = endByte < (long) sizeof(encoder->prefix) ? endByte : (long) sizeof(encoder->prefix);
+        encoder->embed(comps + 2 + index * chunksPerByte - first, encoder->prefix + index, prefixEnd - index);
+        index = prefixEnd;
+    }
+    if (index < endByte) {
+        encoder->embed(comps + 2 + index * chunksPerByte - first, encoder->file + index - sizeof(encoder->prefix), endByte - index);
+    }
 
-    // Lecture des informations de l'image
+    if (b % chunksPerByte != 0) writePartialByte(encoder, comps, first, endByte, endByte * chunksPerByte, b);
+}
 
-    int width, height, channels;
-    uchar *img = stbi_load(IMG_PATH, &width, &height, &channels, USED_CHANNELS);
-    if (img == NULL) {
-        printf("Error in loading the image\n");
-        return 1;
+static void embedSlice(void* arg) {
+    EmbedSlice* slice = arg;
+    embedComponents(slice->encoder, slice->comps, slice->first, slice->count);
+}
+
+static void addEncodedRow(RowEncoder* encoder, const uchar* row) {
+    encoder->failed |= (encoder->rawWriter != NULL ? rawWriterAddRow(encoder->rawWriter, row) : pngWriterAddRow(encoder->writer, row)) != 0;
+}
+
+/*\
+ * Cache les bytes de la bande en cours, une tranche par thread du pool, puis ajoute ses lignes à la sortie.
+ * Les limites entre les tranches tombent entre deux bytes cachés: seules la première et la dernière tranche
+ * peuvent avoir un byte à cheval sur la bande précédente ou la suivante (voir writePartialByte).
+\*/
+static void embedBand(RowEncoder* encoder) {
+    const long first = (long) encoder->bandFirstRow * encoder->rowLength;
+    const long end = first + (long) encoder->bandRows * encoder->rowLength;
+    const long chunksPerByte = 8 / encoder->byteChunkSize;
+    const long hiddenBytes = sizeof(encoder->prefix) + encoder->filelen;
+
+    // Les bytes cachés [firstByte, endByte[ tombent en entier dans la bande
+    const long firstByte = first > 2 ? (first - 2 + chunksPerByte - 1) / chunksPerByte : 0;
+    const long endByte = (end - 2) / chunksPerByte < hiddenBytes ? (end - 2) / chunksPerByte : hiddenBytes;
+    long sliceCount = threadPoolSize(encoder->pool);
+    if (sliceCount > (endByte - firstByte) / MIN_SLICE_LENGTH) sliceCount = (endByte - firstByte) / MIN_SLICE_LENGTH;
+    if (sliceCount < 1) sliceCount = 1;
+
+    TaskGroup group = { 0 };
+    long sliceFirst = first;
+    for (long i = 0; i < sliceCount; i++) {
+        long sliceEnd = end;
+        if (i < sliceCount - 1) {
+            long byte = firstByte + (endByte - firstByte) / sliceCount * (i + 1);
+            byte = (byte + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+            sliceEnd = 2 + (byte < endByte ? byte : endByte) * chunksPerByte;
+            if (sliceEnd < sliceFirst) sliceEnd = sliceFirst;
+        }
+        EmbedSlice* slice = &encoder->slices[i];
+        *slice = (EmbedSlice) { encoder, encoder->bandComps + (sliceFirst - first), sliceFirst, sliceEnd - sliceFirst };
+        if (i < sliceCount - 1) submitGroupTask(encoder->pool, &group, embedSlice, slice);
+        else embedSlice(slice); // La dernière tranche est cachée par ce thread, pendant les autres
+        sliceFirst = sliceEnd;
     }
+    waitTaskGroup(encoder->pool, &group);
 
-    printf("\n");
-    printf("Base image: %s%s%s\n", COLOR, IMG_PATH, RESET);
-    printf("Size: %d x %d px\n", width, height);
-    printf("Used channels: %d / %d\n", USED_CHANNELS, channels);
+    for (int y = 0; y < encoder->bandRows && !encoder->failed; y++) addEncodedRow(encoder, encoder->bandComps + y * encoder->rowLength);
+    encoder->bandRows = 0;
+}
 
-    // Ecriture du BYTE_CHUNK_SIZE_MODE sur les 2 premiers éléments de l'image
+static int encodeRow(void* user, uchar* row, int y) {
+    RowEncoder* encoder = user;
+    const long first = y * encoder->rowLength;
+    if (encoder->cacheEntry != NULL) carrierCacheAddRow(encoder->cacheEntry, row);
+    encoder->rowCount = y + 1;
+
+    // Avec un pool, les lignes qui reçoivent des bytes cachés attendent la fin de leur bande
+    if (encoder->band != NULL && first < encoder->hiddenEnd) {
+        if (encoder->bandRows == 0) {
+            // Le composant 2 + k * CACHE_LINE * chunksPerByte (le byte caché k * CACHE_LINE) est au début d'une ligne de cache
+            encoder->bandFirstRow = y;
+            encoder->bandComps = encoder->band + ((first - 2) & (CACHE_LINE - 1));
+        }
+        memcpy(encoder->bandComps + encoder->bandRows++ * encoder->rowLength, row, encoder->rowLength);
+        if (encoder->bandRows == encoder->bandCapacity || first + encoder->rowLength >= encoder->hiddenEnd) embedBand(encoder);
+        return !encoder->failed;
+    }
 
-    setBitAt(img, 0, getBitAt(BYTE_CHUNK_SIZE_MODE, 0));
-    setBitAt(img + 1, 0, getBitAt(BYTE_CHUNK_SIZE_MODE, 1));
+    embedComponents(encoder, row, first, encoder->rowLength);
+    addEncodedRow(encoder, row);
+    return !encoder->failed;
+}
 
-    // Lecture du fichier
+/*\
+ * Prépare les bandes de encoder si le pool a plusieurs threads et qu'il y a assez de bytes cachés pour les partager.
+ * Sinon (ou si la mémoire manque), chaque ligne est traitée par le thread qui la reçoit.
+\*/
+static void allocateBand(RowEncoder* encoder) {
+    const int threadCount = threadPoolSize(encoder->pool);
+    if (threadCount < 2 || (long) sizeof(encoder->prefix) + encoder->filelen < 2 * MIN_SLICE_LENGTH) return;
+
+    const long hiddenRows = (encoder->hiddenEnd + encoder->rowLength - 1) / encoder->rowLength;
+    long capacity = EMBED_BAND_SIZE / encoder->rowLength;
+    if (capacity < 1) capacity = 1;
+    if (capacity > hiddenRows) capacity = hiddenRows;
+    encoder->bandCapacity = capacity;
+    encoder->slices = malloc(threadCount * sizeof(EmbedSlice));
+    if (encoder->slices == NULL || posix_memalign((void**) &encoder->band, CACHE_LINE, CACHE_LINE + capacity * encoder->rowLength) != 0) {
+        free(encoder->slices);
+        encoder->slices = NULL;
+        encoder->band = NULL;
+    }
+}
+
+static void freeBand(RowEncoder* encoder) {
+    free(encoder->band);
+    free(encoder->slices);
+}
+
+/*\
+ * Une image de test générée ligne par ligne (option --synthetic), pour essayer des tailles d'image
+ * qui n'existent pas sur le disque: des dégradés, qui se compressent comme une photo très lisse.
+ * Renvoie 0 si la mémoire manque.
+\*/
+static int generateCarrier(RowEncoder* encoder, int width, int height) {
+    uchar* row = malloc(encoder->rowLength);
+    uchar* red = malloc(width);
+    if (row == NULL || red == NULL) {
+        free(row);
+        free(red);
+        return 0;
+    }
+    // Le rouge ne dépend que de x: il est calculé une fois (sans division par pixel, pour que --fast-store puisse être mesuré)
+    for (long x = 0; x < width; x++) red[x] = x * 256 / width;
+    for (int y = 0; y < height && !encoder->failed; y++) {
+        const uchar green = (long) y * 256 / height;
+        for (long x = 0; x < width; x++) {
+            row[x * 3] = red[x];
+            row[x * 3 + 1] = green;
+            row[x * 3 + 2] = (x + y) >> 4;
+        }
+        encodeRow(encoder, row, y);
+    }
+    free(row);
+    free(red);
+    return 1;
+}
+
+// Les lignes d'une image trouvée dans le cache, copiées une à une (l'entrée projetée n'est pas modifiée). Renvoie 0 si la mémoire manque
+static int readCachedCarrier(RowEncoder* encoder, const CarrierEntry* entry) {
+    uchar* row = malloc(encoder->rowLength);
+    if (row == NULL) return 0;
+    for (int y = 0; y < entry->height && !encoder->failed; y++) {
+        memcpy(row, entry->pixels + y * encoder->rowLength, encoder->rowLength);
+        encodeRow(encoder, row, y);
+    }
+    free(row);
+    return 1;
+}
+
+/*\
+ * Le nombre de bytes que peut cacher une image de width x height pixels avec ce mode:
+ * chaque composant de pixel contient 1 byteChunk, sauf les 2 premiers réservés pour byteChunkSizeMode,
+ * et le prefix prend sizeof(long) bytes.
+\*/
+static long imageCapacity(int width, int height, uchar byteChunkSizeMode) {
+    const long chunksPerByte = 8 >> byteChunkSizeMode;
+    const long capacity = ((long) width * height * USED_CHANNELS - 2) / chunksPerByte - (long) sizeof(long);
+    return capacity > 0 ? capacity : 0;
+}
 
-    FILE *file;
-    long filelen; // Le nombre d'octets dans le fichier
+/*\
+ * Affiche la capacité de chaque image pour chaque mode, à partir de son en-tête seulement (aucun pixel n'est décodé):
+ * une ligne par image, avec des tabulations pour qu'elle soit facile à trier ou à filtrer.
+ * Renvoie le nombre d'images qui n'ont pas pu être lues.
+\*/
+static int printCapacities(char** imgPaths, int imgCount) {
+    int failures = 0;
+    printf("# image\twidth\theight\tmode 0\tmode 1\tmode 2\tmode 3 (bytes)\n");
+    for (int i = 0; i < imgCount; i++) {
+        int width, height, channels;
+        if (!stbi_info(imgPaths[i], &width, &height, &channels)) {
+            printf("# Error in loading the image: %s\n", imgPaths[i]);
+            failures++;
+            continue;
+        }
+        printf("%s\t%d\t%d", imgPaths[i], width, height);
+        for (uchar mode = 0; mode < 4; mode++) printf("\t%ld", imageCapacity(width, height, mode));
+        printf("\n");
+    }
+    return failures;
+}
 
-    file = fopen(FILE_PATH, "rb"); // on ouvre le fichier en mode rb: read binary
-    if (file == NULL) {
-        printf("Error in reading the file: %s\n", FILE_PATH);
+/*\
+ * Cache le fichier filePath dans l'image imgPath et enregistre le résultat au format png dans outputPath
+ * (ou BMP, TGA, PPM sans compression si c'est l'extension de outputPath).
+ * L'image passe ligne par ligne du décodage à la sortie: seules quelques bandes de lignes sont en mémoire
+ * (sauf si l'image n'est pas un png 8 bits non entrelacé: elle est alors décodée en entier).
+ * Les messages sont écrits dans log. Renvoie 0 si tout s'est bien passé.
+\*/
+int encodeFile(EncodeContext* context, FILE* log, const char* imgPath, const char* filePath, const char* outputPath) {
+    uchar byteChunkSizeMode = context->byteChunkSizeMode;
+    const int autoMode = byteChunkSizeMode == AUTO_BYTE_CHUNK_SIZE_MODE;
+    ThreadPool* pool = context->pool;
+
+    // Lecture des informations de l'image (seulement son en-tête: elle est décodée au fur et à mesure)
+
+    const int synthetic = context->syntheticWidth > 0;
+    int width = context->syntheticWidth, height = context->syntheticHeight, channels = USED_CHANNELS;
+    if (!synthetic && !stbi_info(imgPath, &width, &height, &channels)) {
+        fprintf(log, "Error in loading the image\n");
         return 1;
     }
-    fseek(file, 0, SEEK_END); // On place la tête de lecture à la fin du fichier
-    filelen = ftell(file); // ftell renvoie la position de la tête de lecture (ici, la longueur du fichier)
-    rewind(file); // on remet la tête au début du fichier
 
-    // Note: Le prefix est la zone mémoire où on écrit la valeur de filelen
-    char prefixlen = sizeof(filelen); // La taille du prefix en bytes
-    long bufferlen = filelen + prefixlen; // La taille du buffer en bytes
-    uchar *buffer = malloc(bufferlen * sizeof(char));
+    fprintf(log, "\n");
+    fprintf(log, "Base image: %s%s%s\n", COLOR, synthetic ? "synthetic" : imgPath, RESET);
+    fprintf(log, "Size: %d x %d px\n", width, height);
+    fprintf(log, "Used channels: %d / %d\n", USED_CHANNELS, channels);
 
-    // Le fichier commence <prefixlen> bytes après le buffer
-    uchar *fileBytes = buffer + prefixlen;
-    // fread: lecture du contenu de <file> en <1> bloc de longueur <filelen>,
-    // et stockage du resultat dans le buffer <fileBytes>
-    fread(fileBytes, filelen, 1, file);
+    // Lecture du fichier
 
-    // On convertir le buffer (pointeur de char) en pointeur de long pour 
-    // pouvoir écrire la valeur de filelen sur les premiers bytes du buffer
-    long * filelenPointer = (long*) buffer;
-    *filelenPointer = filelen;
+    Payload payload;
+    if (openPayload(context, filePath, &payload) != 0) {
+        fprintf(log, "Error in reading the file: %s\n", filePath);
+        return 1;
+    }
+    long filelen = payload.length; // Le nombre d'octets dans le fichier
 
     // On affiche les infos du fichier à encoder
-    printf("\n");
-    printf("Target file: %s%s%s\n", COLOR, FILE_PATH, RESET);
-    printf("Size: %ld bytes\n", filelen);
+    fprintf(log, "\n");
+    fprintf(log, "Target file: %s%s%s\n", COLOR, filePath, RESET);
+    fprintf(log, "Size: %ld bytes\n", filelen);
+
+    // En mode auto, on touche le moins de bits possible: le premier mode assez grand pour le fichier
+    if (autoMode) {
+        byteChunkSizeMode = 0;
+        while (byteChunkSizeMode < 3 && filelen > imageCapacity(width, height, byteChunkSizeMode)) byteChunkSizeMode++;
+    }
+    const uchar byteChunkSize = 1 << byteChunkSizeMode;
+
+    fprintf(log, "\n");
+    fprintf(log, "Byte chunk size: %d bit%s\n", byteChunkSize, autoMode ? " (auto)" : "");
+    fprintf(log, "Embedding kernel: %s\n", embedKernelName());
+    fprintf(log, "Capacity: %ld bytes\n", imageCapacity(width, height, byteChunkSizeMode));
+
+    // On s'assure que l'image est assez grande pour contenir le fichier, avant de décoder le moindre pixel
+    if (filelen > imageCapacity(width, height, byteChunkSizeMode)) {
+        fprintf(log, "The image is too small to contain this file !\n");
+        closePayload(&payload);
+        return 1;
+    }
+
+    fprintf(log, "\n");
+    fprintf(log, "Processing...\n");
+    fprintf(log, "Threads: %d\n", threadPoolSize(pool));
+    fprintf(log, "Writing the resulting image to output file...\n");
+
+    // On écrit l'image au format png (ou BMP, TGA, PPM d'après l'extension), ligne par ligne
+    RawFormat rawFormat;
+    const int raw = rawFormatFromPath(outputPath, &rawFormat) == 0;
+    FILE* output = fopen(outputPath, "wb");
+    PngWriter* writer = NULL;
+    RawWriter* rawWriter = NULL;
+    if (output != NULL && raw) rawWriter = rawWriterOpen(output, width, height, rawFormat);
+    if (output != NULL && !raw) writer = pngWriterOpen(output, width, height, USED_CHANNELS, context->compressionLevel, pool, &context->tables);
+    if (writer == NULL && rawWriter == NULL) {
+        fprintf(log, "Error in writing the output image: %s\n", outputPath);
+        if (output != NULL) {
+            fclose(output);
+            remove(outputPath);
+        }
+        closePayload(&payload);
+        return 1;
+    }
+    if (writer != NULL) pngWriterSetFilters(writer, context->filters);
+
+    RowEncoder encoder = {
+        .writer = writer,
+        .rawWriter = rawWriter,
+        .rowLength = (long) width * USED_CHANNELS,
+        .byteChunkSizeMode = byteChunkSizeMode,
+        .byteChunkSize = byteChunkSize,
+        .embed = embedKernel(byteChunkSizeMode),
+        .file = payload.bytes,
+        .filelen = filelen,
+        .pool = pool,
+        .hiddenEnd = 2 + (sizeof(encoder.prefix) + filelen) * (8 / byteChunkSize),
+    };
+    memcpy(encoder.prefix, &filelen, sizeof(filelen));
+    allocateBand(&encoder);
+
+    // Les bytes cachés (et les bits du mode) ne touchent que les premières lignes: si l'image est un png, seules
+    // celles-ci sont réencodées, la suite du flux compressé d'origine est recopiée telle quelle
+    int spliced = 1;
+    if (!synthetic && writer != NULL && context->shouldSplice) {
+        const int dirtyRows = (encoder.hiddenEnd + encoder.rowLength - 1) / encoder.rowLength;
+        spliced = pngSplice(imgPath, dirtyRows, writer, output, encodeRow, &encoder);
+        if (spliced != 1) {
+            freeBand(&encoder);
+            closePayload(&payload);
+            const int written = fclose(output) == 0 && spliced == 0;
+            if (!written) {
+                fprintf(log, "Error in writing the output image: %s\n", outputPath);
+                remove(outputPath);
+                return 1;
+            }
+            fprintf(log, "Re-encoded rows: %d / %d\n", encoder.rowCount, height);
+            fprintf(log, "Done.\n");
+            fprintf(log, "Output image: %s%s%s\n", COLOR, outputPath, RESET);
+            return 0;
+        }
+    }
+
+    // Avec le cache, une image déjà vue n'est pas décodée; sinon ses lignes y sont ajoutées pendant son décodage
+    CarrierEntry cacheEntry;
+    const int useCache = !synthetic && context->cache != NULL;
+    int cached = 0;
+    if (useCache) {
+        cached = carrierCacheLookup(context->cache, imgPath, width, height, &cacheEntry) == 0;
+        fprintf(log, "Carrier cache: %s\n", cached ? "hit" : "miss");
+        if (!cached) encoder.cacheEntry = &cacheEntry;
+    }
+
+    int loaded = synthetic
+        ? generateCarrier(&encoder, width, height)
+        : cached
+        ? readCachedCarrier(&encoder, &cacheEntry)
+        : stbi_png_load_rows(imgPath, &width, &height, &channels, USED_CHANNELS, encodeRow, &encoder);
+    if (!loaded && !synthetic && encoder.rowCount == 0) {
+        // L'image ne peut pas être décodée ligne par ligne: on la décode en entier
+        uchar* img = stbi_load(imgPath, &width, &height, &channels, USED_CHANNELS);
+        loaded = img != NULL;
+        for (int y = 0; loaded && y < height && !encoder.failed; y++) encodeRow(&encoder, img + y * encoder.rowLength, y);
+        stbi_image_free(img);
+    }
+    if (useCache) carrierCacheRelease(context->cache, &cacheEntry, loaded);
+    freeBand(&encoder);
+    closePayload(&payload);
+
+    // On termine le png (le buffer du fichier est gardé pour la tâche suivante)
+    int written = (rawWriter != NULL ? rawWriterClose(rawWriter) : pngWriterClose(writer)) == 0;
+    written &= fclose(output) == 0;
 
-    // Le nombre de composants de pixels dans l'image
-    int imgSize = width * height * USED_CHANNELS;
-    // Le nombre de byteChunk = le nombre de bytes multiplié par le nombre de byteChunk dans 1 byte
-    long byteChunkCount = bufferlen * (8 / byteChunkSize);
-    // On s'assure que l'image est assez grande pour contenir tous les byteChunk
-    // (Chaque composant de pixel peut contenir 1 byteChunk)
-    // On enlève 2 à imgSize car 2 composants sont révervés pour écrire BYTE_CHUNK_SIZE_MODE
-    if (imgSize - 2 < byteChunkCount) {
-        printf("The image is too small to contain this file !\n");
+    if (!loaded) {
+        fprintf(log, "Error in loading the image\n");
+        remove(outputPath);
+        return 1;
+    }
+    if (!written) {
+        fprintf(log, "Error in writing the output image: %s\n", outputPath);
+        remove(outputPath);
         return 1;
     }
 
+    fprintf(log, "Done.\n");
+    fprintf(log, "Output image: %s%s%s\n", COLOR, outputPath, RESET);
+    return 0;
+}
+
+static int runEncodeJob(void* context, const Job* job, FILE* log) {
+    return encodeFile(context, log, job->paths[0], job->paths[1], job->paths[2]);
+}
+
+static void printUsage(const char* program) {
+    printf("Usage: %s [options] <image> <file> <output>\n", program);
+    printf("       %s [options] -b <batch list>\n", program);
+    printf("       %s [options] --synthetic <width>x<height> <file> <output>\n", program);
+    printf("       %s --capacity <image>...\n", program);
+    printf("Hides <file> in <image> and writes the result as a png to <output>,\n");
+    printf("or as an uncompressed bmp, tga or ppm when <output> has that extension.\n");
     printf("\n");
-    printf("Processing...\n");
-
-    // On écrit à partir du 2e élément de img car les deux premiers sont réservés pour BYTE_CHUNK_SIZE_MODE
-    writeBufferToImg(img + 2, buffer, bufferlen, byteChunkSize);
-
-    printf("Writing the resulting image to output file...\n");
-    // On écrit l'image au format png:
-    // OUTPUT_PATH: le chemin où on enregistre l'image; width et height: la taille de l'image
-    // USED_CHANNELS: le nombre de channels utilisés dans l'image enregistrée
-    // img: le buffer contenant l'image
-    // width * USED_CHANNELS: la taille (en bytes) d'une ligne de pixels sur l'image
-    stbi_write_png(OUTPUT_PATH, width, height, USED_CHANNELS, img, width * USED_CHANNELS);
-
-    printf("Done.\n");
-    printf("Output image: %s%s%s\n", COLOR, OUTPUT_PATH, RESET);
-
-    // On libère la mémoire
-    free(buffer);
-    stbi_image_free(img);
-}
\ No newline at end of file
+    printf("Options:\n");
+    printf("  -m, --mode <0-3|auto>   bits used per pixel component: 0: 1 bit, 1: 2 bits, 2: 4 bits, 3: 8 bits,\n");
+    printf("                          auto: the fewest bits that fit <file> (default: %d)\n", DEFAULT_BYTE_CHUNK_SIZE_MODE);
+    printf("  -z, --compression <0-9> png compression level, 0 to store without compression (default: %d)\n", DEFAULT_COMPRESSION_LEVEL);
+    printf("  -f, --filters <filters> png filters tried on each row: all (default), up-sub (faster),\n");
+    printf("                          paeth or none (no heuristic, fastest)\n");
+    printf("      --fast-store        store the png without compression or filters (same as -z 0 -f none),\n");
+    printf("                          for outputs that are compressed again or archived anyway\n");
+    printf("      --no-splice         re-encode every row of a png <image>, instead of only the rows that\n");
+    printf("                          change and a copy of the rest of its compressed data\n");
+    printf("                          (implied by -z, -f and --fast-store, which apply to the whole image,\n");
+    printf("                          and by --cache)\n");
+    printf("      --cache <dir>       keep the decoded pixels of every <image> in <dir>, keyed by the image\n");
+    printf("                          content, so that the next runs with the same image skip its decoding\n");
+    printf("                          (every row is then re-encoded, as with --no-splice)\n");
+    printf("      --cache-size <MB>   evict the least recently used images beyond this size (default: %d)\n", DEFAULT_CACHE_SIZE);
+    printf("      --cache-stats       print the cache hits, misses and evictions and its size at the end\n");
+    printf("  -t, --threads <n>       number of threads, 0 for one per core (default: 0): they embed <file>\n");
+    printf("                          and compress the png band by band, or run the jobs of a batch\n");
+    printf("  -b, --batch <list>      process every \"<image> <file> <output>\" line of <list> (- for stdin),\n");
+    printf("                          running one job per thread\n");
+    printf("      --synthetic <w>x<h> hide <file> in a generated <w> x <h> gradient instead of an image file,\n");
+    printf("                          to try carrier sizes that do not exist on disk\n");
+    printf("      --capacity          print how many bytes each <image> can hide in every mode,\n");
+    printf("                          reading only the image headers\n");
+    printf("      --check-kernels     check the optimized kernels against the reference loops first\n");
+    printf("      --bench-kernels     print the throughput of every kernel in every mode, then exit\n");
+    printf("      --slow-inflate      decompress the image with the reference inflate loop\n");
+    printf("                          instead of the fast one, to compare them\n");
+    printf("  -h, --help              show this help\n");
+}
+
+int main(int argc, char** argv) {
+    int byteChunkSizeMode = DEFAULT_BYTE_CHUNK_SIZE_MODE;
+    int compressionLevel = DEFAULT_COMPRESSION_LEVEL;
+    const char* filterName = "all";
+    int threadCount = 0;
+    const char* batchPath = NULL;
+    int shouldCheckKernels = 0;
+    int shouldInflateFast = 1;
+    int shouldSplice = 1;
+    const char* cachePath = NULL;
+    long cacheSize = DEFAULT_CACHE_SIZE;
+    int shouldPrintCacheStats = 0;
+    int shouldPrintCapacities = 0;
+    int syntheticWidth = 0, syntheticHeight = 0;
+
+    const struct option longOptions[] = {
+        { "mode", required_argument, NULL, 'm' },
+        { "compression", required_argument, NULL, 'z' },
+        { "filters", required_argument, NULL, 'f' },
+        { "fast-store", no_argument, NULL, 'S' },
+        { "no-splice", no_argument, NULL, 'N' },
+        { "cache", required_argument, NULL, 'C' },
+        { "cache-size", required_argument, NULL, 'Z' },
+        { "cache-stats", no_argument, NULL, 'T' },
+        { "threads", required_argument, NULL, 't' },
+        { "batch", required_argument, NULL, 'b' },
+        { "capacity", no_argument, NULL, 'c' },
+        { "synthetic", required_argument, NULL, 's' },
+        { "check-kernels", no_argument, NULL, 'k' },
+        { "bench-kernels", no_argument, NULL, 'B' },
+        { "slow-inflate", no_argument, NULL, 'I' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "m:z:f:t:b:h", longOptions, NULL)) != -1) {
+        switch (option) {
+            case 'm': byteChunkSizeMode = strcmp(optarg, "auto") == 0 ? AUTO_BYTE_CHUNK_SIZE_MODE : atoi(optarg); break;
+            // La compression choisie s'applique à toute l'image: la fin d'un png ne peut pas être reprise telle quelle
+            case 'z':
+                compressionLevel = atoi(optarg);
+                shouldSplice = 0;
+                break;
+            case 'f':
+                filterName = optarg;
+                shouldSplice = 0;
+                break;
+            case 'S':
+                shouldSplice = 0;
+                compressionLevel = 0;
+                filterName = "none";
+                break;
+            case 'N': shouldSplice = 0; break;
+            // Une image reprise en partie n'est pas décodée: ni lue dans le cache, ni ajoutée
+            case 'C':
+                cachePath = optarg;
+                shouldSplice = 0;
+                break;
+            case 'Z': cacheSize = atol(optarg); break;
+            case 'T': shouldPrintCacheStats = 1; break;
+            case 't': threadCount = atoi(optarg); break;
+            case 'b': batchPath = optarg; break;
+            case 'c': shouldPrintCapacities = 1; break;
+            case 's':
+                if (sscanf(optarg, "%dx%d", &syntheticWidth, &syntheticHeight) != 2 || syntheticWidth <= 0 || syntheticHeight <= 0) {
+                    printf("The synthetic image size must be <width>x<height>, but found %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'k': shouldCheckKernels = 1; break;
+            case 'B': benchKernels(); return 0;
+            case 'I': shouldInflateFast = 0; break;
+            case 'h': printUsage(argv[0]); return 0;
+            default: printUsage(argv[0]); return 1;
+        }
+    }
+
+    const int pathCount = argc - optind;
+    if (shouldPrintCapacities) {
+        if (pathCount == 0 || batchPath != NULL) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return printCapacities(argv + optind, pathCount) == 0 ? 0 : 1;
+    }
+    // Avec --synthetic, il n'y a pas de chemin d'image
+    const int imagePathCount = syntheticWidth > 0 ? 0 : 1;
+    if ((batchPath == NULL && pathCount != 2 + imagePathCount) || (batchPath != NULL && (pathCount != 0 || syntheticWidth > 0))) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if ((byteChunkSizeMode < 0 || byteChunkSizeMode > 3) && byteChunkSizeMode != AUTO_BYTE_CHUNK_SIZE_MODE) {
+        printf("The mode must be between 0 and 3, but found %d\n", byteChunkSizeMode);
+        return 1;
+    }
+    if (compressionLevel < 0 || compressionLevel > 9) {
+        printf("The compression level must be between 0 and 9, but found %d\n", compressionLevel);
+        return 1;
+    }
+    static const char* filterNames[] = { [PNG_FILTERS_ALL] = "all", [PNG_FILTERS_UP_SUB] = "up-sub", [PNG_FILTERS_PAETH] = "paeth", [PNG_FILTERS_NONE] = "none" };
+    int filters = 0;
+    while (filters < 4 && strcmp(filterName, filterNames[filters]) != 0) filters++;
+    if (filters == 4) {
+        printf("The filters must be all, up-sub, paeth or none, but found %s\n", filterName);
+        return 1;
+    }
+    if (threadCount < 0) {
+        printf("The thread count must be positive, but found %d\n", threadCount);
+        return 1;
+    }
+    if (cacheSize <= 0) {
+        printf("The cache size must be positive, but found %ld\n", cacheSize);
+        return 1;
+    }
+    if (shouldPrintCacheStats && cachePath == NULL) {
+        printf("--cache-stats needs a cache directory (--cache <dir>)\n");
+        return 1;
+    }
+    CarrierCache cache;
+    if (cachePath != NULL && carrierCacheInit(&cache, cachePath, cacheSize * 1048576) != 0) {
+        printf("Error in opening the cache directory: %s\n", cachePath);
+        return 1;
+    }
+
+    if (shouldCheckKernels && checkKernels() + checkPngDecoding() != 0) {
+        printf("The optimized kernels do not match the reference loops\n");
+        return 1;
+    }
+    stbi_zlib_set_fast_inflate(shouldInflateFast);
+
+    // Sans liste, une seule tâche donnée directement sur la ligne de commande
+    Job singleJob = { 0 };
+    JobList list = { &singleJob, 1 };
+    if (batchPath == NULL) {
+        for (int i = 0; i < pathCount; i++) singleJob.paths[i + 1 - imagePathCount] = argv[optind + i];
+    } else if (readJobList(batchPath, 3, &list) != 0) {
+        return 1;
+    }
+
+    // Avec un seul thread, pas besoin de pool: tout est fait sur le thread principal
+    ThreadPool *pool = threadCount == 1 ? NULL : createThreadPool(threadCount);
+
+    int failures;
+    if (batchPath == NULL) {
+        // Une seule tâche: les threads cachent le fichier dans les bandes de lignes et compressent les bandes du png
+        EncodeContext context = {
+            .pool = pool,
+            .byteChunkSizeMode = byteChunkSizeMode,
+            .compressionLevel = compressionLevel,
+            .filters = filters,
+            .syntheticWidth = syntheticWidth,
+            .syntheticHeight = syntheticHeight,
+            .shouldSplice = shouldSplice,
+            .cache = cachePath != NULL ? &cache : NULL,
+        };
+        failures = encodeFile(&context, stdout, singleJob.paths[0], singleJob.paths[1], singleJob.paths[2]);
+        free(context.buffer);
+        pngTablesFree(&context.tables);
+    } else {
+        // Plusieurs tâches: chaque thread traite ses tâches seul, avec ses propres buffers
+        const int contextCount = threadPoolSize(pool);
+        EncodeContext* contexts = calloc(contextCount, sizeof(EncodeContext));
+        void** contextPointers = malloc(contextCount * sizeof(void*));
+        for (int i = 0; i < contextCount; i++) {
+            contexts[i].byteChunkSizeMode = byteChunkSizeMode;
+            contexts[i].compressionLevel = compressionLevel;
+            contexts[i].filters = filters;
+            contexts[i].shouldSplice = shouldSplice;
+            contexts[i].cache = cachePath != NULL ? &cache : NULL;
+            contextPointers[i] = &contexts[i];
+        }
+
+        failures = runJobs(&list, pool, runEncodeJob, contextPointers);
+
+        printf("Batch done: %d / %d succeeded\n", list.count - failures, list.count);
+        for (int i = 0; i < contextCount; i++) {
+            free(contexts[i].buffer);
+            pngTablesFree(&contexts[i].tables);
+        }
+        free(contexts);
+        free(contextPointers);
+        freeJobList(&list);
+    }
+    destroyThreadPool(pool);
+    if (shouldPrintCacheStats) carrierCachePrintStats(&cache, stdout);
+    if (cachePath != NULL) carrierCacheFree(&cache);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -1,19 +1,25 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "stb_image.h"
-#include "stb_image_write.h"
+
+#include "kernels.h"
+#include "pngcheck.h"
+#include "batch.h"
 
 #define COLOR "\e[38;5;4m" // Blue
 #define RESET "\e[m"
 
 #define USED_CHANNELS 3
 
-#define IMG_PATH "output/out.png"
-#define OUTPUT_PATH "extracted/out.png"
-
-typedef unsigned char uchar;
+// Les tailles et positions sont des long: il leur faut 64 bits (le prefix fait sizeof(long) bytes)
+_Static_assert(sizeof(long) == 8, "long must be 64-bit");
 
 uchar getBitAt(uchar byte, uchar index) {
     return (byte >> index) & 1;
@@ -26,104 +32,539 @@ void setBitAt(uchar* byte, uchar index, uchar bit) {
     *byte |= bit << index;
 }
 
-char* extractBytes(uchar* img, long byteCount, uchar byteChunkSize, long offset) {
-    const uchar lastBitsMask = 
-        byteChunkSize == 8 ? 0b11111111 : 
-        byteChunkSize == 4 ? 0b00001111 : 
-        byteChunkSize == 2 ? 0b00000011 : 
-        byteChunkSize == 1 ? 0b00000001 : 0;
-
-    char* buffer = calloc(byteCount, sizeof(char));
-    long bufferIndex = 0;
-    char bytePos = 0;
-
-    // imgIndex est statique pour que la progression dans l'image soit conservée d'appel en appel
-    long imgIndex = offset;
-    
-    // Le nombre de byteChunk = le nombre de bytes multiplié par le nombre de byteChunk dans 1 byte
-    int byteChunkCount = byteCount * (8 / byteChunkSize);
-    long targetImgIndex = imgIndex + byteChunkCount;
-
-    for (; imgIndex < targetImgIndex; imgIndex++) {
-        // le byte correspondant à la valeur du composant de pixel
-        char imageByte = img[imgIndex];
-        // On ne veut que les derniers bits
-        char byteChunk = imageByte & lastBitsMask;
-        // On décale le byteChunk pour qu'il soit au bon endroit dans le byte
-        byteChunk <<= 8 - bytePos - byteChunkSize;
-        // On ajoute le byteChunk au byte courant du buffer
-        // (on est assurés que byteChunk ne dépasse pas le nombre de bits de byteChunkSize)
-        buffer[bufferIndex] |= byteChunk;
-
-        bytePos += byteChunkSize;
-        if (bytePos >= 8) {
-            bytePos = 0;
-            bufferIndex++;
+// La taille des morceaux du fichier extrait écrits d'un coup (un multiple de la taille des pages)
+#define WRITE_CHUNK_SIZE (1024 * 1024)
+
+/*\
+ * Avec plusieurs threads et un fichier extrait projeté en mémoire, les composants du fichier sont rassemblés
+ * en bandes d'environ EXTRACT_BAND_SIZE composants, et chaque bande est découpée en tranches extraites en même
+ * temps sur le pool. Les tranches commencent sur un byte du fichier multiple de CACHE_LINE (la projection commence
+ * sur une page): deux threads n'écrivent jamais dans la même ligne de cache. En dessous de MIN_SLICE_LENGTH bytes
+ * par tranche, la synchronisation coûte plus qu'elle ne rapporte.
+\*/
+#define EXTRACT_BAND_SIZE (4 * 1024 * 1024)
+#define CACHE_LINE 64
+#define MIN_SLICE_LENGTH (16 * 1024)
+
+// Ce qui est gardé d'une tâche à l'autre par un thread
+typedef struct {
+    ThreadPool* pool;     // Le pool qui extrait les bandes, ou écrit le fichier extrait pendant le décodage (NULL: le thread courant)
+    uchar* buffer;        // Les deux buffers d'écriture du fichier extrait, alignés sur une page
+} ExtractContext;
+
+typedef enum {
+    EXTRACT_HEADER,       // Le mode et le prefix ne sont pas encore lus
+    EXTRACT_FILE,         // Le fichier est en cours d'extraction
+    EXTRACT_DONE,
+    EXTRACT_NO_FILE,
+    EXTRACT_WRITE_ERROR,
+} ExtractStatus;
+
+typedef struct {
+    int fd;
+    const uchar* data;
+    long length;
+    int failed;
+} WriteTask;
+
+// Les bytes [0, length[ de buffer, rassemblés depuis comps
+typedef struct {
+    ExtractKernel extract;
+    uchar* buffer;
+    const uchar* comps;
+    long length;
+} ExtractSlice;
+
+/*\
+ * L'extraction ligne par ligne: les composants de chaque ligne décodée sont rassemblés en bytes
+ * directement dans le fichier extrait projeté en mémoire (mapping). Si le fichier ne peut pas être projeté
+ * (un pipe, un disque plein...), ils sont rassemblés dans un buffer, écrit dans le fichier extrait dès qu'il
+ * est plein (sur le pool pendant que le décodage continue dans l'autre buffer).
+ * Le décodage s'arrête après la dernière ligne qui contient le fichier caché.
+\*/
+typedef struct {
+    ThreadPool* pool;
+    const char* outputPath;
+    long rowLength;           // Le nombre de composants de pixel dans une ligne
+    long imgSize;             // Le nombre de composants de pixels dans l'image
+    int rowCount;             // Les lignes déjà décodées
+    ExtractStatus status;
+
+    long headerCount;         // Les composants du mode et du prefix déjà lus
+    uchar byteChunkSizeMode;
+    unsigned long prefix;     // Le prefix, décodé au fur et à mesure des composants
+    uchar byteChunkSize;
+    ExtractKernel extract;    // Le noyau spécialisé pour le mode
+    long chunksPerByte;
+
+    long filelen;
+    long fileEnd;             // La fin des composants du fichier dans l'image
+    uchar carry[8];           // Les composants d'un byte à cheval sur deux lignes
+    int carryCount;
+
+    int fd;                   // Le fichier extrait, tant qu'il est ouvert
+    int opened;
+    uchar* mapping;           // Le fichier extrait projeté en mémoire (NULL: écrit par morceaux depuis les buffers)
+    long mapped;              // Les bytes déjà rassemblés dans mapping
+    uchar* buffers[2];
+    int current;              // Le buffer qui reçoit les bytes, l'autre peut être en cours d'écriture
+    long fill;
+    WriteTask write;
+
+    uchar* band;              // Les composants du fichier en attente d'être extraits (NULL: extraits dès qu'ils arrivent)
+    long bandFill;
+    ExtractSlice* slices;     // Une tranche par thread du pool
+} RowExtractor;
+
+/*\
+ * Ajoute au prefix le byteChunk caché dans le composant index du prefix.
+ * Le prefix est caché byte par byte dans l'ordre de la mémoire (un long natif), chaque byte en commençant par ses bits de poids fort.
+\*/
+static void readPrefixChunk(RowExtractor* extractor, long index, uchar comp) {
+    const long byte = index / extractor->chunksPerByte;
+    const long chunk = index % extractor->chunksPerByte;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    const int byteShift = 8 * (sizeof(long) - 1 - byte);
+#else
+    const int byteShift = 8 * byte;
+#endif
+    const int shift = byteShift + (extractor->chunksPerByte - 1 - chunk) * extractor->byteChunkSize;
+    const uchar lastBitsMask = (1 << extractor->byteChunkSize) - 1;
+    extractor->prefix |= (unsigned long) (comp & lastBitsMask) << shift;
+}
+
+static void writeTask(void* arg) {
+    WriteTask* task = arg;
+    long done = 0;
+    while (done < task->length) {
+        const ssize_t count = write(task->fd, task->data + done, task->length - done);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) {
+            task->failed = 1;
+            return;
         }
+        done += count;
     }
+}
+
+// Envoie le buffer en cours à l'écriture, après avoir attendu la fin de l'écriture précédente
+static void flushBuffer(RowExtractor* extractor) {
+    if (extractor->pool != NULL) waitTasks(extractor->pool);
+    if (extractor->write.failed) extractor->status = EXTRACT_WRITE_ERROR;
+
+    extractor->write.data = extractor->buffers[extractor->current];
+    extractor->write.length = extractor->fill;
+    if (extractor->pool != NULL) {
+        submitTask(extractor->pool, writeTask, &extractor->write);
+        extractor->current ^= 1;
+    } else {
+        writeTask(&extractor->write);
+    }
+    extractor->fill = 0;
+}
+
+/*\
+ * Projette le fichier extrait, de filelen bytes, en mémoire: les bytes sont alors rassemblés directement
+ * dans le cache du système, sans copie. La place est réservée avant (posix_fallocate) pour qu'un disque plein
+ * soit une erreur ici plutôt qu'un SIGBUS pendant l'extraction. Renvoie NULL si ce n'est pas possible.
+\*/
+static uchar* mapOutput(int fd, long filelen) {
+    if (filelen == 0) return NULL;
+    if (ftruncate(fd, filelen) != 0 || posix_fallocate(fd, 0, filelen) != 0) return NULL;
 
-    return buffer;
+    void* mapping = mmap(NULL, filelen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) return NULL;
+    madvise(mapping, filelen, MADV_SEQUENTIAL);
+    return mapping;
 }
 
-int main() {
+static void unmapOutput(RowExtractor* extractor) {
+    if (extractor->mapping == NULL) return;
+    if (munmap(extractor->mapping, extractor->filelen) != 0) extractor->write.failed = 1;
+    extractor->mapping = NULL;
+}
+
+static void finishFile(RowExtractor* extractor) {
+    if (extractor->mapping != NULL) {
+        unmapOutput(extractor);
+    } else {
+        flushBuffer(extractor);
+        if (extractor->pool != NULL) waitTasks(extractor->pool);
+    }
+    const int failed = extractor->write.failed | (close(extractor->fd) != 0);
+    extractor->fd = -1;
+    extractor->status = failed ? EXTRACT_WRITE_ERROR : EXTRACT_DONE;
+}
+
+// Rassemble count bytes des composants comps dans le fichier projeté ou les buffers d'écriture
+static void gatherBytes(RowExtractor* extractor, const uchar* comps, long count) {
+    if (extractor->mapping != NULL) {
+        extractor->extract(extractor->mapping + extractor->mapped, comps, count);
+        extractor->mapped += count;
+        return;
+    }
+    while (count > 0 && extractor->status == EXTRACT_FILE) {
+        const long space = WRITE_CHUNK_SIZE - extractor->fill;
+        const long length = count < space ? count : space;
+        extractor->extract(extractor->buffers[extractor->current] + extractor->fill, comps, length);
+        extractor->fill += length;
+        comps += length * extractor->chunksPerByte;
+        count -= length;
+        if (extractor->fill == WRITE_CHUNK_SIZE) flushBuffer(extractor);
+    }
+}
+
+static void extractSlice(void* arg) {
+    ExtractSlice* slice = arg;
+    slice->extract(slice->buffer, slice->comps, slice->length);
+}
+
+/*\
+ * Extrait les bytes complets de la bande dans le fichier projeté, une tranche par thread du pool.
+ * Les composants d'un byte qui n'est pas complet restent au début de la bande.
+\*/
+static void extractBand(RowExtractor* extractor) {
+    const long chunksPerByte = extractor->chunksPerByte;
+    const long byteCount = extractor->bandFill / chunksPerByte;
+    const long first = extractor->mapped;
+    const long end = first + byteCount;
+    long sliceCount = threadPoolSize(extractor->pool);
+    if (sliceCount > byteCount / MIN_SLICE_LENGTH) sliceCount = byteCount / MIN_SLICE_LENGTH;
+    if (sliceCount < 1) sliceCount = 1;
+
+    TaskGroup group = { 0 };
+    long sliceFirst = first;
+    for (long i = 0; i < sliceCount; i++) {
+        long sliceEnd = end;
+        if (i < sliceCount - 1) {
+            sliceEnd = (first + byteCount / sliceCount * (i + 1) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+            if (sliceEnd > end) sliceEnd = end;
+            if (sliceEnd < sliceFirst) sliceEnd = sliceFirst;
+        }
+        ExtractSlice* slice = &extractor->slices[i];
+        *slice = (ExtractSlice) {
+            extractor->extract, extractor->mapping + sliceFirst, extractor->band + (sliceFirst - first) * chunksPerByte, sliceEnd - sliceFirst,
+        };
+        if (i < sliceCount - 1) submitGroupTask(extractor->pool, &group, extractSlice, slice);
+        else extractSlice(slice); // La dernière tranche est extraite par ce thread, pendant les autres
+        sliceFirst = sliceEnd;
+    }
+    waitTaskGroup(extractor->pool, &group);
+
+    extractor->mapped = end;
+    extractor->bandFill -= byteCount * chunksPerByte;
+    memmove(extractor->band, extractor->band + byteCount * chunksPerByte, extractor->bandFill);
+}
+
+/*\
+ * Prépare la bande si le fichier est projeté, que le pool a plusieurs threads et que le fichier est assez grand
+ * pour les partager. Sinon (ou si la mémoire manque), les composants sont extraits dès qu'ils arrivent.
+\*/
+static void allocateBand(RowExtractor* extractor) {
+    const int threadCount = threadPoolSize(extractor->pool);
+    if (extractor->mapping == NULL || threadCount < 2 || extractor->filelen < 2 * MIN_SLICE_LENGTH) return;
+    // Une bande peut dépasser EXTRACT_BAND_SIZE d'une ligne, plus les composants d'un byte incomplet
+    extractor->band = malloc(EXTRACT_BAND_SIZE + extractor->rowLength + 8);
+    extractor->slices = malloc(threadCount * sizeof(ExtractSlice));
+    if (extractor->band == NULL || extractor->slices == NULL) {
+        free(extractor->band);
+        free(extractor->slices);
+        extractor->band = NULL;
+        extractor->slices = NULL;
+    }
+}
+
+// Lit le mode puis le prefix dans les composants [first, end[; renvoie la position du premier composant qui suit
+static long readHeader(RowExtractor* extractor, const uchar* row, long first, long end) {
+    long pos = first;
+    long needed = extractor->headerCount < 2 ? 2 : 2 + sizeof(long) * extractor->chunksPerByte;
+    while (pos < end && extractor->headerCount < needed) {
+        const uchar comp = row[pos++ - first];
+        const long index = extractor->headerCount++;
+        if (index >= 2) {
+            readPrefixChunk(extractor, index - 2, comp);
+            continue;
+        }
+
+        setBitAt(&extractor->byteChunkSizeMode, index, getBitAt(comp, 0));
+        if (extractor->headerCount == 2) {
+            const uchar byteChunkSizeMode = extractor->byteChunkSizeMode;
+            // Le mode tient sur 2 bits: byteChunkSize (1, 2, 4 ou 8) divise toujours 8
+            extractor->byteChunkSize = 1 << byteChunkSizeMode;
+            extractor->chunksPerByte = 8 / extractor->byteChunkSize;
+            extractor->extract = extractKernel(byteChunkSizeMode);
+            needed = 2 + sizeof(long) * extractor->chunksPerByte;
+        }
+    }
+    if (extractor->headerCount < needed) return end;
+
+    const long filelen = extractor->prefix;
+
+    // Si l'image ne contient pas de fichier, le prefix peut contenir n'importe quoi
+    if (filelen < 0 || filelen > (extractor->imgSize - pos) / extractor->chunksPerByte) {
+        extractor->status = EXTRACT_NO_FILE;
+        return end;
+    }
+
+    extractor->fd = open(extractor->outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (extractor->fd < 0) {
+        extractor->status = EXTRACT_WRITE_ERROR;
+        return end;
+    }
+    extractor->opened = 1;
+    extractor->write.fd = extractor->fd;
+    // Si la projection échoue après avoir donné sa taille au fichier, les écritures le remplissent depuis le début
+    extractor->mapping = mapOutput(extractor->fd, filelen);
+    extractor->filelen = filelen;
+    extractor->fileEnd = pos + filelen * extractor->chunksPerByte;
+    extractor->status = EXTRACT_FILE;
+    allocateBand(extractor);
+    return pos;
+}
+
+static int extractRow(void* user, uchar* row, int y) {
+    RowExtractor* extractor = user;
+    const long first = y * extractor->rowLength;
+    long pos = first;
+    long end = first + extractor->rowLength;
+    extractor->rowCount = y + 1;
+
+    if (extractor->status == EXTRACT_HEADER) pos = readHeader(extractor, row, first, end);
+    if (extractor->status != EXTRACT_FILE) return extractor->status == EXTRACT_HEADER;
+
+    if (end > extractor->fileEnd) end = extractor->fileEnd;
+    const uchar* comps = row + (pos - first);
+    long count = end - pos;
+
+    // Avec une bande, les composants attendent qu'elle soit pleine (ou la fin du fichier) pour être extraits ensemble
+    if (extractor->band != NULL) {
+        memcpy(extractor->band + extractor->bandFill, comps, count);
+        extractor->bandFill += count;
+        if (extractor->bandFill >= EXTRACT_BAND_SIZE || end == extractor->fileEnd) extractBand(extractor);
+        if (end == extractor->fileEnd) finishFile(extractor);
+        return extractor->status == EXTRACT_FILE;
+    }
+
+    // On termine d'abord le byte commencé sur la ligne précédente
+    if (extractor->carryCount > 0) {
+        while (count > 0 && extractor->carryCount < extractor->chunksPerByte) {
+            extractor->carry[extractor->carryCount++] = *comps++;
+            count--;
+        }
+        if (extractor->carryCount == extractor->chunksPerByte) {
+            gatherBytes(extractor, extractor->carry, 1);
+            extractor->carryCount = 0;
+        }
+    }
+
+    const long byteCount = count / extractor->chunksPerByte;
+    gatherBytes(extractor, comps, byteCount);
+    comps += byteCount * extractor->chunksPerByte;
+    count -= byteCount * extractor->chunksPerByte;
+    while (count > 0) {
+        extractor->carry[extractor->carryCount++] = *comps++;
+        count--;
+    }
+
+    if (end == extractor->fileEnd && extractor->status == EXTRACT_FILE) finishFile(extractor);
+    return extractor->status == EXTRACT_FILE;
+}
+
+/*\
+ * Extrait le fichier caché dans l'image imgPath et l'enregistre dans outputPath.
+ * L'image est décodée ligne par ligne, seulement jusqu'à la fin du fichier caché, et le fichier est écrit
+ * au fur et à mesure: la mémoire utilisée ne dépend pas de sa taille (sauf si l'image n'est pas un png
+ * 8 bits non entrelacé: elle est alors décodée en entier).
+ * Les messages sont écrits dans log. Renvoie 0 si tout s'est bien passé.
+\*/
+int extractFile(ExtractContext* context, FILE* log, const char* imgPath, const char* outputPath) {
+    ThreadPool* pool = context->pool;
+
     // === Lecture des informations de l'image ===
 
     int width, height, channels;
-    uchar *img = stbi_load(IMG_PATH, &width, &height, &channels, USED_CHANNELS);
-    if (img == NULL) {
-        printf("Error in loading the image\n");
-        return 1;        
+    if (!stbi_info(imgPath, &width, &height, &channels)) {
+        fprintf(log, "Error in loading the image\n");
+        return 1;
     }
 
-    printf("Source image: %s%s%s\n", COLOR, IMG_PATH, RESET);
-    printf("Size: %d x %d px\n", width, height);
-    printf("Used channels: %d / %d\n", USED_CHANNELS, channels);
+    fprintf(log, "Source image: %s%s%s\n", COLOR, imgPath, RESET);
+    fprintf(log, "Size: %d x %d px\n", width, height);
+    fprintf(log, "Used channels: %d / %d\n", USED_CHANNELS, channels);
 
-    // Lecture du byteChunkSizeMode et calcul de byteChunkSize
+    if (context->buffer == NULL && posix_memalign((void**) &context->buffer, 4096, 2 * WRITE_CHUNK_SIZE) != 0) {
+        context->buffer = NULL;
+        fprintf(log, "Not enough memory\n");
+        return 1;
+    }
 
-    uchar byteChunkSizeMode = 0;
-    setBitAt(&byteChunkSizeMode, 0, getBitAt(img[0], 0));
-    setBitAt(&byteChunkSizeMode, 1, getBitAt(img[1], 0));
+    // === Extraction du fichier, pendant le décodage ===
 
-    const uchar byteChunkSize = pow(2, byteChunkSizeMode);
-    if (8 % byteChunkSize != 0) {
-        printf("Byte chunk size must be a divisor of 8, but found %d\n", byteChunkSize);
+    RowExtractor extractor = {
+        .pool = pool,
+        .outputPath = outputPath,
+        .rowLength = (long) width * USED_CHANNELS,
+        .imgSize = (long) width * height * USED_CHANNELS,
+        .status = EXTRACT_HEADER,
+        .fd = -1,
+        .buffers = { context->buffer, context->buffer + WRITE_CHUNK_SIZE },
+    };
+
+    int loaded = stbi_png_load_rows(imgPath, &width, &height, &channels, USED_CHANNELS, extractRow, &extractor);
+    if (!loaded && extractor.rowCount == 0) {
+        // L'image ne peut pas être décodée ligne par ligne: on la décode en entier
+        uchar* img = stbi_load(imgPath, &width, &height, &channels, USED_CHANNELS);
+        loaded = img != NULL;
+        for (int y = 0; loaded && y < height; y++) {
+            if (!extractRow(&extractor, img + y * extractor.rowLength, y)) break;
+        }
+        stbi_image_free(img);
+    }
+
+    if (extractor.fd >= 0) {
+        // Le fichier n'a pas été écrit jusqu'au bout (le décodage s'est arrêté avant sa fin, ou une écriture a échoué)
+        if (pool != NULL) waitTasks(pool);
+        unmapOutput(&extractor);
+        close(extractor.fd);
+        if (extractor.status == EXTRACT_FILE) loaded = 0;
+    }
+    free(extractor.band);
+    free(extractor.slices);
+    if (extractor.opened && extractor.status != EXTRACT_DONE) remove(outputPath);
+    if (!loaded) {
+        fprintf(log, "Error in loading the image\n");
         return 1;
     }
 
-    printf("\n");
-    printf("Byte chunk size: %d bit\n", byteChunkSize);
+    fprintf(log, "Decoded rows: %d / %d\n", extractor.rowCount, height);
 
-    // === Extraction du fichier ===
-    // Note: Le prefix est la zone mémoire où on écrit la valeur de filelen
+    fprintf(log, "\n");
+    fprintf(log, "Byte chunk size: %d bit\n", extractor.byteChunkSize);
+    fprintf(log, "Extraction kernel: %s\n", extractKernelName());
+    fprintf(log, "Threads: %d\n", threadPoolSize(pool));
 
-    long imgPos = 2; // On commence au 2e composant de l'image
+    // Une image trop petite pour le prefix ne peut pas contenir de fichier
+    if (extractor.status == EXTRACT_HEADER || extractor.status == EXTRACT_NO_FILE) {
+        fprintf(log, "The image does not contain a hidden file !\n");
+        return 1;
+    }
 
-    long filelen; // La taille du fichier en bytes
-    char prefixlen = sizeof(filelen); // La taille du prefix en bytes
-    char *prefixBuffer = extractBytes(img, prefixlen, byteChunkSize, imgPos); // On extrait la valeur du préfix sous forme de buffer de char
-    filelen = *((long*) prefixBuffer); // On assigne la valeur (il faut caster le pointeur puis déréférencer)
-    imgPos += prefixlen * (8 / byteChunkSize); // On déplace la position de lecture dans l'image
+    // === Ecriture du fichier décodé ===
 
-    char *buffer = extractBytes(img, filelen, byteChunkSize, imgPos); // On extrait le fichier
+    fprintf(log, "\n");
+    fprintf(log, "Writing the result to output file...\n");
+    if (extractor.status == EXTRACT_WRITE_ERROR) {
+        fprintf(log, "Error in writing the output file: %s\n", outputPath);
+        return 1;
+    }
 
-    // === Ecriture du fichier décodé ===
-    
+    fprintf(log, "Done.\n");
+    fprintf(log, "Output file: %s%s%s\n", COLOR, outputPath, RESET);
+    fprintf(log, "Size: %ld bytes\n", extractor.filelen);
+    return 0;
+}
+
+static int runExtractJob(void* context, const Job* job, FILE* log) {
+    return extractFile(context, log, job->paths[0], job->paths[1]);
+}
+
+static void printUsage(const char* program) {
+    printf("Usage: %s [options] <image> <output>\n", program);
+    printf("       %s [options] -b <batch list>\n", program);
+    printf("Extracts the file hidden in <image> and writes it to <output>.\n");
     printf("\n");
-    printf("Writing the result to output file...\n");
-
-    // on ouvre le fichier en mode wb: write binary
-    FILE *file = fopen(OUTPUT_PATH, "wb");
-    // fwrite: écriture du contenu du <buffer> en <1> bloc de longueur <extractedFileSize>,
-    // et stockage du resultat dans le fichier <file>
-    fwrite(buffer, filelen, 1, file);
-
-    printf("Done.\n");
-    printf("Output file: %s%s%s\n", COLOR, OUTPUT_PATH, RESET);
-    printf("Size: %ld bytes\n", filelen);
-
-    // On libère la mémoire
-    free(prefixBuffer);
-    free(buffer);
-    stbi_image_free(img);
-}
\ No newline at end of file
+    printf("Options:\n");
+    printf("  -t, --threads <n>       number of threads, 0 for one per core (default: 0): they extract the\n");
+    printf("                          file band by band (or write <output> when it cannot be memory-mapped),\n");
+    printf("                          or run the jobs of a batch\n");
+    printf("  -b, --batch <list>      process every \"<image> <output>\" line of <list> (- for stdin),\n");
+    printf("                          running one job per thread\n");
+    printf("      --check-kernels     check the optimized kernels against the reference loops first\n");
+    printf("      --bench-kernels     print the throughput of every kernel in every mode, then exit\n");
+    printf("      --slow-inflate      decompress the image with the reference inflate loop\n");
+    printf("                          instead of the fast one, to compare them\n");
+    printf("  -h, --help              show this help\n");
+}
+
+int main(int argc, char** argv) {
+    int threadCount = 0;
+    const char* batchPath = NULL;
+    int shouldCheckKernels = 0;
+    int shouldInflateFast = 1;
+
+    const struct option longOptions[] = {
+        { "threads", required_argument, NULL, 't' },
+        { "batch", required_argument, NULL, 'b' },
+        { "check-kernels", no_argument, NULL, 'k' },
+        { "bench-kernels", no_argument, NULL, 'B' },
+        { "slow-inflate", no_argument, NULL, 'I' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "t:b:h", longOptions, NULL)) != -1) {
+        switch (option) {
+            case 't': threadCount = atoi(optarg); break;
+            case 'b': batchPath = optarg; break;
+            case 'k': shouldCheckKernels = 1; break;
+            case 'B': benchKernels(); return 0;
+            case 'I': shouldInflateFast = 0; break;
+            case 'h': printUsage(argv[0]); return 0;
+            default: printUsage(argv[0]); return 1;
+        }
+    }
+
+    const int pathCount = argc - optind;
+    if ((batchPath == NULL && pathCount != 2) || (batchPath != NULL && pathCount != 0)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (threadCount < 0) {
+        printf("The thread count must be positive, but found %d\n", threadCount);
+        return 1;
+    }
+
+    if (shouldCheckKernels && checkKernels() + checkPngDecoding() != 0) {
+        printf("The optimized kernels do not match the reference loops\n");
+        return 1;
+    }
+    stbi_zlib_set_fast_inflate(shouldInflateFast);
+
+    // Sans liste, une seule tâche donnée directement sur la ligne de commande
+    Job singleJob = { 0 };
+    JobList list = { &singleJob, 1 };
+    if (batchPath == NULL) {
+        for (int i = 0; i < 2; i++) singleJob.paths[i] = argv[optind + i];
+    } else if (readJobList(batchPath, 2, &list) != 0) {
+        return 1;
+    }
+
+    // Avec un seul thread, pas besoin de pool: tout est fait sur le thread principal
+    ThreadPool *pool = threadCount == 1 ? NULL : createThreadPool(threadCount);
+
+    int failures;
+    if (batchPath == NULL) {
+        // Une seule tâche: le fichier est extrait par bandes sur le pool (ou écrit sur le pool) pendant le décodage
+        ExtractContext context = { .pool = pool };
+        failures = extractFile(&context, stdout, singleJob.paths[0], singleJob.paths[1]);
+        free(context.buffer);
+    } else {
+        // Plusieurs tâches: chaque thread traite ses tâches seul, avec ses propres buffers
+        const int contextCount = threadPoolSize(pool);
+        ExtractContext* contexts = calloc(contextCount, sizeof(ExtractContext));
+        void** contextPointers = malloc(contextCount * sizeof(void*));
+        for (int i = 0; i < contextCount; i++) contextPointers[i] = &contexts[i];
+
+        failures = runJobs(&list, pool, runExtractJob, contextPointers);
+
+        printf("Batch done: %d / %d succeeded\n", list.count - failures, list.count);
+        for (int i = 0; i < contextCount; i++) free(contexts[i].buffer);
+        free(contexts);
+        free(contextPointers);
+        freeJobList(&list);
+    }
+    destroyThreadPool(pool);
+
+    return failures == 0 ? 0 : 1;
+}
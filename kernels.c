@@ -0,0 +1,771 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+void writeBufferToImgScalar(uchar* img, const uchar* buffer, const long bufferLength, const uchar byteChunkSize) {
+    const uchar lastBitsMask =
+        byteChunkSize == 8 ? 0b11111111 :
+        byteChunkSize == 4 ? 0b00001111 :
+        byteChunkSize == 2 ? 0b00000011 :
+        byteChunkSize == 1 ? 0b00000001 : 0;
+
+    // Le nombre de byteChunk = le nombre de bytes multiplié par le nombre de byteChunk dans 1 byte
+    const long byteChunkCount = bufferLength * (8 / byteChunkSize);
+
+    long bufferIndex = 0;
+    uchar bytePos = 0;
+    for (long imageIndex = 0; imageIndex < byteChunkCount; imageIndex++) {
+
+        // On lit le byte courant du buffer
+        uchar byte = buffer[bufferIndex];
+        // On décale le byteChunk pour qu'il soit positionné au début du byte
+        uchar byteChunk = byte >> (8 - bytePos - byteChunkSize);
+        // On met à 0 les éventuels bits qui sont à gauche du byteChunk
+        byteChunk &= lastBitsMask;
+
+        // On incrémente la position du byteChunk dans le byte
+        bytePos += byteChunkSize;
+        // Si bytePos est à 8, on passe au prochain byte
+        if (bytePos == 8) {
+            bytePos = 0;
+            bufferIndex++;
+        }
+
+        // le byte correspondant à la valeur du composant de pixel
+        uchar imageByte = img[imageIndex];
+        // On met à zéro les derniers bits du byte avec le mask
+        imageByte &= ~lastBitsMask;
+        // On ajoute le byteChunk à la place des bits qui ont été mis à zéro
+        // (on est assurés que byteChunk ne dépasse pas le nombre de bits de byteChunkSize
+        imageByte |= byteChunk;
+        // On réassigne le nouveau byte modifié à l'image
+        img[imageIndex] = imageByte;
+    }
+}
+
+void readBufferFromImgScalar(uchar* buffer, const uchar* img, const long bufferLength, const uchar byteChunkSize) {
+    const uchar lastBitsMask =
+        byteChunkSize == 8 ? 0b11111111 :
+        byteChunkSize == 4 ? 0b00001111 :
+        byteChunkSize == 2 ? 0b00000011 :
+        byteChunkSize == 1 ? 0b00000001 : 0;
+
+    // Le nombre de byteChunk = le nombre de bytes multiplié par le nombre de byteChunk dans 1 byte
+    const long byteChunkCount = bufferLength * (8 / byteChunkSize);
+
+    long bufferIndex = 0;
+    uchar bytePos = 0;
+    for (long imgIndex = 0; imgIndex < byteChunkCount; imgIndex++) {
+        // Le buffer n'est pas forcément initialisé: on remet le byte à 0 avant d'y ajouter le 1er byteChunk
+        if (bytePos == 0) buffer[bufferIndex] = 0;
+
+        // le byte correspondant à la valeur du composant de pixel
+        uchar imageByte = img[imgIndex];
+        // On ne veut que les derniers bits
+        uchar byteChunk = imageByte & lastBitsMask;
+        // On décale le byteChunk pour qu'il soit au bon endroit dans le byte
+        byteChunk <<= 8 - bytePos - byteChunkSize;
+        // On ajoute le byteChunk au byte courant du buffer
+        // (on est assurés que byteChunk ne dépasse pas le nombre de bits de byteChunkSize)
+        buffer[bufferIndex] |= byteChunk;
+
+        bytePos += byteChunkSize;
+        if (bytePos >= 8) {
+            bytePos = 0;
+            bufferIndex++;
+        }
+    }
+}
+
+/*\
+ * Les mêmes boucles, écrites pour être compilées une fois par taille de byteChunk (voir SPECIALIZE_KERNEL):
+ * le masque et le nombre de byteChunk par byte sont alors des constantes, et la boucle interne est déroulée.
+ * Elles traitent aussi les bytes restants des autres versions.
+\*/
+
+static inline __attribute__((always_inline))
+void writeChunks(uchar* img, const uchar* buffer, const long bufferLength, const uchar byteChunkSize) {
+    const uchar lastBitsMask = (1 << byteChunkSize) - 1;
+    const int chunksPerByte = 8 / byteChunkSize;
+    for (long i = 0; i < bufferLength; i++) {
+        const uchar byte = buffer[i];
+        uchar* out = img + i * chunksPerByte;
+        for (int j = 0; j < chunksPerByte; j++) {
+            const uchar byteChunk = (byte >> (8 - (j + 1) * byteChunkSize)) & lastBitsMask;
+            out[j] = (out[j] & ~lastBitsMask) | byteChunk;
+        }
+    }
+}
+
+static inline __attribute__((always_inline))
+void readChunks(uchar* buffer, const uchar* img, const long bufferLength, const uchar byteChunkSize) {
+    const uchar lastBitsMask = (1 << byteChunkSize) - 1;
+    const int chunksPerByte = 8 / byteChunkSize;
+    for (long i = 0; i < bufferLength; i++) {
+        const uchar* in = img + i * chunksPerByte;
+        uchar byte = 0;
+        for (int j = 0; j < chunksPerByte; j++) byte = (byte << byteChunkSize) | (in[j] & lastBitsMask);
+        buffer[i] = byte;
+    }
+}
+
+/*\
+ * Versions "mot par mot" portables: 8 composants de pixel sont traités d'un coup dans un entier de 64 bits.
+ * Les byteChunk sont étalés (ou rassemblés) avec des décalages, des masques et des multiplications,
+ * ce qui revient à un pdep / pext avec un masque fixe, sans instruction particulière.
+ * Ce sont les versions utilisées quand le processeur n'est pas un x86.
+\*/
+
+typedef unsigned long long u64;
+
+// Etale byteChunkSize bytes du buffer (lus en little endian) sur 8 composants
+static inline u64 spreadChunks(u64 bytes, const uchar byteChunkSize) {
+    u64 x;
+    switch (byteChunkSize) {
+        case 1:
+            // Chaque byte du résultat garde un bit différent du byte, puis on le ramène sur le bit 0
+            x = (bytes * 0x0101010101010101ULL) & 0x0102040810204080ULL;
+            return ((x + 0x7F7F7F7F7F7F7F7FULL) & 0x8080808080808080ULL) >> 7;
+        case 2:
+            // 1 byte du buffer par mot de 32 bits, puis 1 byteChunk par byte
+            x = (bytes | bytes << 24) & 0x000000FF000000FFULL;
+            return ((x >> 6) & 0x0000000300000003ULL) | ((x << 4) & 0x0000030000000300ULL)
+                | ((x << 14) & 0x0003000000030000ULL) | ((x << 24) & 0x0300000003000000ULL);
+        case 4:
+            // 1 byte du buffer par mot de 16 bits
+            x = (bytes | bytes << 16) & 0x0000FFFF0000FFFFULL;
+            x = (x | x << 8) & 0x00FF00FF00FF00FFULL;
+            return ((x >> 4) & 0x000F000F000F000FULL) | ((x << 8) & 0x0F000F000F000F00ULL);
+        default:
+            return bytes;
+    }
+}
+
+// L'opération inverse: rassemble les byteChunk de 8 composants en byteChunkSize bytes (little endian)
+static inline u64 gatherChunks(u64 imageBytes, const uchar byteChunkSize) {
+    u64 x;
+    switch (byteChunkSize) {
+        case 1:
+            // La multiplication aligne le dernier bit de chaque composant dans le byte de poids fort
+            return ((imageBytes & 0x0101010101010101ULL) * 0x8040201008040201ULL) >> 56;
+        case 2:
+            x = imageBytes & 0x0303030303030303ULL;
+            x = ((x << 6) & 0x000000C0000000C0ULL) | ((x >> 4) & 0x0000003000000030ULL)
+                | ((x >> 14) & 0x0000000C0000000CULL) | ((x >> 24) & 0x0000000300000003ULL);
+            return (x | x >> 24) & 0xFFFF;
+        case 4:
+            x = imageBytes & 0x0F0F0F0F0F0F0F0FULL;
+            x = ((x << 4) & 0x00F000F000F000F0ULL) | ((x >> 8) & 0x000F000F000F000FULL);
+            x = (x | x >> 8) & 0x0000FFFF0000FFFFULL;
+            return (x | x >> 16) & 0xFFFFFFFF;
+        default:
+            return imageBytes;
+    }
+}
+
+// byteChunkSize est une constante dans chaque appel ci-dessous: les memcpy deviennent de simples lectures
+static inline __attribute__((always_inline))
+long writeWords(uchar* img, const uchar* buffer, const long bufferLength, const uchar byteChunkSize) {
+    const u64 mask = 0x0101010101010101ULL * (uchar) ((1 << byteChunkSize) - 1);
+    long i = 0;
+    for (; i + byteChunkSize <= bufferLength; i += byteChunkSize) {
+        u64 bytes = 0, imageBytes;
+        memcpy(&bytes, buffer + i, byteChunkSize);
+        uchar* out = img + i * (8 / byteChunkSize);
+        memcpy(&imageBytes, out, sizeof(imageBytes));
+        imageBytes = (imageBytes & ~mask) | spreadChunks(bytes, byteChunkSize);
+        memcpy(out, &imageBytes, sizeof(imageBytes));
+    }
+    return i;
+}
+
+static inline __attribute__((always_inline))
+long readWords(uchar* buffer, const uchar* img, const long bufferLength, const uchar byteChunkSize) {
+    long i = 0;
+    for (; i + byteChunkSize <= bufferLength; i += byteChunkSize) {
+        u64 imageBytes;
+        memcpy(&imageBytes, img + i * (8 / byteChunkSize), sizeof(imageBytes));
+        u64 bytes = gatherChunks(imageBytes, byteChunkSize);
+        memcpy(buffer + i, &bytes, byteChunkSize);
+    }
+    return i;
+}
+
+static inline __attribute__((always_inline))
+void writeBufferToImgWord(uchar* img, const uchar* buffer, const long bufferLength, const uchar byteChunkSize) {
+    long i = 0;
+    switch (byteChunkSize) {
+        case 1: i = writeWords(img, buffer, bufferLength, 1); break;
+        case 2: i = writeWords(img, buffer, bufferLength, 2); break;
+        case 4: i = writeWords(img, buffer, bufferLength, 4); break;
+        case 8: memcpy(img, buffer, bufferLength); return;
+    }
+
+    writeChunks(img + i * (8 / byteChunkSize), buffer + i, bufferLength - i, byteChunkSize);
+}
+
+static inline __attribute__((always_inline))
+void readBufferFromImgWord(uchar* buffer, const uchar* img, const long bufferLength, const uchar byteChunkSize) {
+    long i = 0;
+    switch (byteChunkSize) {
+        case 1: i = readWords(buffer, img, bufferLength, 1); break;
+        case 2: i = readWords(buffer, img, bufferLength, 2); break;
+        case 4: i = readWords(buffer, img, bufferLength, 4); break;
+        case 8: memcpy(buffer, img, bufferLength); return;
+    }
+
+    readChunks(buffer + i, img + i * (8 / byteChunkSize), bufferLength - i, byteChunkSize);
+}
+
+#ifdef KERNELS_X86
+
+/*\
+ * Version SSE2: on traite 16 bytes du buffer par tour de boucle.
+ * Les byteChunk sont séparés avec des décalages et des masques, puis remis dans l'ordre
+ * (du poids fort au poids faible) en entrelaçant les registres avec unpack.
+ * Les bytes restants sont confiés à la boucle de référence.
+\*/
+
+__attribute__((target("sse2")))
+static inline void mergeSse2(uchar* img, __m128i chunks, __m128i mask) {
+    __m128i imageBytes = _mm_loadu_si128((__m128i*) img);
+    imageBytes = _mm_or_si128(_mm_andnot_si128(mask, imageBytes), chunks);
+    _mm_storeu_si128((__m128i*) img, imageBytes);
+}
+
+__attribute__((target("sse2"), always_inline))
+static inline void writeBufferToImgSse2(uchar* img, const uchar* buffer, const long bufferLength, const uchar byteChunkSize) {
+    long i = 0;
+
+    if (byteChunkSize == 8) {
+        // Les byteChunk remplacent entièrement les composants
+        memcpy(img, buffer, bufferLength);
+        return;
+    }
+
+    if (byteChunkSize == 4) {
+        const __m128i mask = _mm_set1_epi8(0x0F);
+        for (; i + 16 <= bufferLength; i += 16) {
+            __m128i bytes = _mm_loadu_si128((__m128i*) (buffer + i));
+            __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+            __m128i low = _mm_and_si128(bytes, mask);
+            uchar* out = img + i * 2;
+            mergeSse2(out, _mm_unpacklo_epi8(high, low), mask);
+            mergeSse2(out + 16, _mm_unpackhi_epi8(high, low), mask);
+        }
+    } else if (byteChunkSize == 2) {
+        const __m128i mask = _mm_set1_epi8(0x03);
+        for (; i + 16 <= bufferLength; i += 16) {
+            __m128i bytes = _mm_loadu_si128((__m128i*) (buffer + i));
+            // a, b, c, d: les 4 byteChunk de chaque byte, du poids fort au poids faible
+            __m128i a = _mm_and_si128(_mm_srli_epi16(bytes, 6), mask);
+            __m128i b = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+            __m128i c = _mm_and_si128(_mm_srli_epi16(bytes, 2), mask);
+            __m128i d = _mm_and_si128(bytes, mask);
+            __m128i abLow = _mm_unpacklo_epi8(a, b);
+            __m128i abHigh = _mm_unpackhi_epi8(a, b);
+            __m128i cdLow = _mm_unpacklo_epi8(c, d);
+            __m128i cdHigh = _mm_unpackhi_epi8(c, d);
+            uchar* out = img + i * 4;
+            mergeSse2(out, _mm_unpacklo_epi16(abLow, cdLow), mask);
+            mergeSse2(out + 16, _mm_unpackhi_epi16(abLow, cdLow), mask);
+            mergeSse2(out + 32, _mm_unpacklo_epi16(abHigh, cdHigh), mask);
+            mergeSse2(out + 48, _mm_unpackhi_epi16(abHigh, cdHigh), mask);
+        }
+    } else if (byteChunkSize == 1) {
+        const __m128i mask = _mm_set1_epi8(0x01);
+        // Le bit à isoler pour chaque composant d'un groupe de 8
+        const __m128i bitSelect = _mm_setr_epi8(
+            (char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+            (char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+        for (; i + 16 <= bufferLength; i += 16) {
+            __m128i bytes = _mm_loadu_si128((__m128i*) (buffer + i));
+            // On répète chaque byte 8 fois: chaque registre contient alors 2 bytes du buffer
+            __m128i x2[2] = { _mm_unpacklo_epi8(bytes, bytes), _mm_unpackhi_epi8(bytes, bytes) };
+            uchar* out = img + i * 8;
+            for (int j = 0; j < 2; j++) {
+                __m128i x4[2] = { _mm_unpacklo_epi16(x2[j], x2[j]), _mm_unpackhi_epi16(x2[j], x2[j]) };
+                for (int k = 0; k < 2; k++) {
+                    __m128i x8[2] = { _mm_unpacklo_epi32(x4[k], x4[k]), _mm_unpackhi_epi32(x4[k], x4[k]) };
+                    for (int l = 0; l < 2; l++) {
+                        __m128i bits = _mm_cmpeq_epi8(_mm_and_si128(x8[l], bitSelect), bitSelect);
+                        mergeSse2(out, _mm_and_si128(bits, mask), mask);
+                        out += 16;
+                    }
+                }
+            }
+        }
+    }
+
+    writeChunks(img + i * (8 / byteChunkSize), buffer + i, bufferLength - i, byteChunkSize);
+}
+
+/*\
+ * Version AVX2: 32 composants de pixel sont écrits par tour de boucle.
+ * Les bytes du buffer sont élargis (cvtepu8) pour que chaque byteChunk puisse être placé
+ * à sa position finale avec de simples décalages, sans problème de croisement entre les lanes.
+\*/
+
+__attribute__((target("avx2")))
+static inline void mergeAvx2(uchar* img, __m256i chunks, __m256i mask) {
+    __m256i imageBytes = _mm256_loadu_si256((__m256i*) img);
+    imageBytes = _mm256_or_si256(_mm256_andnot_si256(mask, imageBytes), chunks);
+    _mm256_storeu_si256((__m256i*) img, imageBytes);
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void writeBufferToImgAvx2(uchar* img, const uchar* buffer, const long bufferLength, const uchar byteChunkSize) {
+    long i = 0;
+
+    if (byteChunkSize == 8) {
+        memcpy(img, buffer, bufferLength);
+        return;
+    }
+
+    if (byteChunkSize == 4) {
+        const __m256i mask = _mm256_set1_epi8(0x0F);
+        const __m256i secondChunk = _mm256_set1_epi16(0x0F00);
+        for (; i + 16 <= bufferLength; i += 16) {
+            // 1 byte du buffer par mot de 16 bits: le 1er byteChunk va dans le byte bas, le 2e dans le byte haut
+            __m256i words = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) (buffer + i)));
+            __m256i chunks = _mm256_or_si256(
+                _mm256_srli_epi16(words, 4),
+                _mm256_and_si256(_mm256_slli_epi16(words, 8), secondChunk));
+            mergeAvx2(img + i * 2, chunks, mask);
+        }
+    } else if (byteChunkSize == 2) {
+        const __m256i mask = _mm256_set1_epi8(0x03);
+        for (; i + 8 <= bufferLength; i += 8) {
+            // 1 byte du buffer par mot de 32 bits, un byteChunk dans chacun des 4 bytes
+            __m256i dwords = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*) (buffer + i)));
+            __m256i chunks = _mm256_srli_epi32(dwords, 6);
+            chunks = _mm256_or_si256(chunks, _mm256_and_si256(_mm256_slli_epi32(dwords, 4), _mm256_set1_epi32(0x00000300)));
+            chunks = _mm256_or_si256(chunks, _mm256_and_si256(_mm256_slli_epi32(dwords, 14), _mm256_set1_epi32(0x00030000)));
+            chunks = _mm256_or_si256(chunks, _mm256_and_si256(_mm256_slli_epi32(dwords, 24), _mm256_set1_epi32(0x03000000)));
+            mergeAvx2(img + i * 4, chunks, mask);
+        }
+    } else if (byteChunkSize == 1) {
+        const __m256i mask = _mm256_set1_epi8(0x01);
+        const __m256i bitSelect = _mm256_setr_epi8(
+            (char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+            (char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+            (char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+            (char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+        // Chaque lane reçoit les 4 bytes; on répète le byte 0 et 1 dans la 1re lane, 2 et 3 dans la 2e
+        const __m256i spread = _mm256_setr_epi8(
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+        for (; i + 4 <= bufferLength; i += 4) {
+            int fourBytes;
+            memcpy(&fourBytes, buffer + i, sizeof(fourBytes));
+            __m256i bytes = _mm256_shuffle_epi8(_mm256_set1_epi32(fourBytes), spread);
+            __m256i bits = _mm256_cmpeq_epi8(_mm256_and_si256(bytes, bitSelect), bitSelect);
+            mergeAvx2(img + i * 8, _mm256_and_si256(bits, mask), mask);
+        }
+    }
+
+    writeChunks(img + i * (8 / byteChunkSize), buffer + i, bufferLength - i, byteChunkSize);
+}
+
+/*\
+ * Versions SSE2 / AVX2 de l'extraction: on lit des registres entiers de composants de pixel
+ * et on écrit des mots entiers du buffer.
+ * Les byteChunk sont rassemblés avec des décalages dans des mots de 16 ou 32 bits, puis compactés
+ * avec pack. En mode 1 bit, movemask récupère directement le dernier bit de chaque composant.
+\*/
+
+// Inverse l'ordre des bits d'un byte (movemask place le 1er composant sur le bit de poids faible)
+static inline uchar reverseBits(uchar byte) {
+    return ((byte * 0x80200802ULL) & 0x0884422110ULL) * 0x0101010101ULL >> 32;
+}
+
+__attribute__((target("sse2")))
+static inline __m128i gatherChunks2Sse2(const uchar* img) {
+    // 4 composants par mot de 32 bits: le 1er byteChunk va sur les bits de poids fort du byte
+    __m128i dwords = _mm_loadu_si128((__m128i*) img);
+    __m128i bytes = _mm_slli_epi32(_mm_and_si128(dwords, _mm_set1_epi32(0x03)), 6);
+    bytes = _mm_or_si128(bytes, _mm_and_si128(_mm_srli_epi32(dwords, 4), _mm_set1_epi32(0x30)));
+    bytes = _mm_or_si128(bytes, _mm_and_si128(_mm_srli_epi32(dwords, 14), _mm_set1_epi32(0x0C)));
+    return _mm_or_si128(bytes, _mm_and_si128(_mm_srli_epi32(dwords, 24), _mm_set1_epi32(0x03)));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i gatherChunks4Sse2(const uchar* img) {
+    // 2 composants par mot de 16 bits
+    __m128i words = _mm_loadu_si128((__m128i*) img);
+    __m128i high = _mm_and_si128(_mm_slli_epi16(words, 4), _mm_set1_epi16(0x00F0));
+    __m128i low = _mm_and_si128(_mm_srli_epi16(words, 8), _mm_set1_epi16(0x000F));
+    return _mm_or_si128(high, low);
+}
+
+__attribute__((target("sse2"), always_inline))
+static inline void readBufferFromImgSse2(uchar* buffer, const uchar* img, const long bufferLength, const uchar byteChunkSize) {
+    long i = 0;
+
+    if (byteChunkSize == 8) {
+        memcpy(buffer, img, bufferLength);
+        return;
+    }
+
+    if (byteChunkSize == 4) {
+        for (; i + 16 <= bufferLength; i += 16) {
+            const uchar* in = img + i * 2;
+            __m128i bytes = _mm_packus_epi16(gatherChunks4Sse2(in), gatherChunks4Sse2(in + 16));
+            _mm_storeu_si128((__m128i*) (buffer + i), bytes);
+        }
+    } else if (byteChunkSize == 2) {
+        for (; i + 16 <= bufferLength; i += 16) {
+            const uchar* in = img + i * 4;
+            __m128i low = _mm_packs_epi32(gatherChunks2Sse2(in), gatherChunks2Sse2(in + 16));
+            __m128i high = _mm_packs_epi32(gatherChunks2Sse2(in + 32), gatherChunks2Sse2(in + 48));
+            _mm_storeu_si128((__m128i*) (buffer + i), _mm_packus_epi16(low, high));
+        }
+    } else if (byteChunkSize == 1) {
+        for (; i + 8 <= bufferLength; i += 8) {
+            u64 bytes = 0;
+            for (int j = 0; j < 4; j++) {
+                __m128i imageBytes = _mm_loadu_si128((__m128i*) (img + i * 8 + j * 16));
+                // On amène le dernier bit de chaque composant sur le bit de poids fort pour movemask
+                unsigned int bits = _mm_movemask_epi8(_mm_slli_epi16(imageBytes, 7));
+                bytes |= (u64) reverseBits(bits) << (j * 16);
+                bytes |= (u64) reverseBits(bits >> 8) << (j * 16 + 8);
+            }
+            memcpy(buffer + i, &bytes, sizeof(bytes));
+        }
+    }
+
+    readChunks(buffer + i, img + i * (8 / byteChunkSize), bufferLength - i, byteChunkSize);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i gatherChunks2Avx2(const uchar* img) {
+    __m256i dwords = _mm256_loadu_si256((__m256i*) img);
+    __m256i bytes = _mm256_slli_epi32(_mm256_and_si256(dwords, _mm256_set1_epi32(0x03)), 6);
+    bytes = _mm256_or_si256(bytes, _mm256_and_si256(_mm256_srli_epi32(dwords, 4), _mm256_set1_epi32(0x30)));
+    bytes = _mm256_or_si256(bytes, _mm256_and_si256(_mm256_srli_epi32(dwords, 14), _mm256_set1_epi32(0x0C)));
+    return _mm256_or_si256(bytes, _mm256_and_si256(_mm256_srli_epi32(dwords, 24), _mm256_set1_epi32(0x03)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i gatherChunks4Avx2(const uchar* img) {
+    __m256i words = _mm256_loadu_si256((__m256i*) img);
+    __m256i high = _mm256_and_si256(_mm256_slli_epi16(words, 4), _mm256_set1_epi16(0x00F0));
+    __m256i low = _mm256_and_si256(_mm256_srli_epi16(words, 8), _mm256_set1_epi16(0x000F));
+    return _mm256_or_si256(high, low);
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void readBufferFromImgAvx2(uchar* buffer, const uchar* img, const long bufferLength, const uchar byteChunkSize) {
+    long i = 0;
+
+    if (byteChunkSize == 8) {
+        memcpy(buffer, img, bufferLength);
+        return;
+    }
+
+    if (byteChunkSize == 4) {
+        for (; i + 32 <= bufferLength; i += 32) {
+            const uchar* in = img + i * 2;
+            // pack travaille lane par lane: on remet les 4 quarts dans l'ordre avec permute4x64
+            __m256i bytes = _mm256_packus_epi16(gatherChunks4Avx2(in), gatherChunks4Avx2(in + 32));
+            bytes = _mm256_permute4x64_epi64(bytes, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256((__m256i*) (buffer + i), bytes);
+        }
+    } else if (byteChunkSize == 2) {
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        for (; i + 32 <= bufferLength; i += 32) {
+            const uchar* in = img + i * 4;
+            __m256i low = _mm256_packs_epi32(gatherChunks2Avx2(in), gatherChunks2Avx2(in + 32));
+            __m256i high = _mm256_packs_epi32(gatherChunks2Avx2(in + 64), gatherChunks2Avx2(in + 96));
+            __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(low, high), order);
+            _mm256_storeu_si256((__m256i*) (buffer + i), bytes);
+        }
+    } else if (byteChunkSize == 1) {
+        // On inverse l'ordre des composants dans chaque groupe de 8 pour que movemask
+        // place le 1er composant sur le bit de poids fort du byte
+        const __m256i reverse = _mm256_setr_epi8(
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+        for (; i + 4 <= bufferLength; i += 4) {
+            __m256i imageBytes = _mm256_loadu_si256((__m256i*) (img + i * 8));
+            imageBytes = _mm256_shuffle_epi8(imageBytes, reverse);
+            unsigned int bytes = _mm256_movemask_epi8(_mm256_slli_epi16(imageBytes, 7));
+            memcpy(buffer + i, &bytes, sizeof(bytes));
+        }
+    }
+
+    readChunks(buffer + i, img + i * (8 / byteChunkSize), bufferLength - i, byteChunkSize);
+}
+
+/*\
+ * Version BMI2: pdep étale en une instruction les byteChunk sur 8 composants de pixel.
+ * Les bytes du buffer sont lus en big endian pour que le 1er byteChunk soit sur les bits de poids fort,
+ * et le résultat est inversé pour que ce byteChunk arrive dans le 1er composant.
+\*/
+
+__attribute__((target("bmi2"), always_inline))
+static inline void writeBufferToImgBmi2(uchar* img, const uchar* buffer, const long bufferLength, const uchar byteChunkSize) {
+    long i = 0;
+
+    if (byteChunkSize == 8) {
+        memcpy(img, buffer, bufferLength);
+        return;
+    }
+
+    const u64 chunkMask = 0x0101010101010101ULL * ((1 << byteChunkSize) - 1);
+    for (; i + 8 <= bufferLength; i += 8) {
+        u64 bytes;
+        memcpy(&bytes, buffer + i, sizeof(bytes));
+        bytes = __builtin_bswap64(bytes);
+        // 8 bytes du buffer couvrent 8 / byteChunkSize mots de 8 composants
+        for (int j = 0; j < 8; j += byteChunkSize) {
+            uchar* out = img + (i + j) * (8 / byteChunkSize);
+            u64 chunks = bytes >> (64 - 8 * byteChunkSize);
+            bytes <<= 8 * byteChunkSize;
+            u64 imageBytes;
+            memcpy(&imageBytes, out, sizeof(imageBytes));
+            imageBytes = (imageBytes & ~chunkMask) | __builtin_bswap64(_pdep_u64(chunks, chunkMask));
+            memcpy(out, &imageBytes, sizeof(imageBytes));
+        }
+    }
+
+    writeChunks(img + i * (8 / byteChunkSize), buffer + i, bufferLength - i, byteChunkSize);
+}
+
+/*\
+ * Version BMI2: pext rassemble en une instruction les byteChunk de 8 composants de pixel.
+ * On inverse l'ordre des bytes avant pext pour que le 1er composant arrive sur les bits de poids fort,
+ * puis on inverse à nouveau le résultat pour écrire les bytes du buffer dans l'ordre.
+\*/
+
+__attribute__((target("bmi2"), always_inline))
+static inline void readBufferFromImgBmi2(uchar* buffer, const uchar* img, const long bufferLength, const uchar byteChunkSize) {
+    long i = 0;
+
+    if (byteChunkSize == 8) {
+        memcpy(buffer, img, bufferLength);
+        return;
+    }
+
+    const u64 chunkMask = 0x0101010101010101ULL * ((1 << byteChunkSize) - 1);
+    // 8 composants contiennent byteChunkSize bytes du buffer
+    for (; i + 8 <= bufferLength; i += 8) {
+        u64 bytes = 0;
+        for (int j = 0; j < 8; j += byteChunkSize) {
+            u64 imageBytes;
+            memcpy(&imageBytes, img + (i + j) * (8 / byteChunkSize), sizeof(imageBytes));
+            u64 chunks = _pext_u64(__builtin_bswap64(imageBytes), chunkMask);
+            bytes |= __builtin_bswap64(chunks << (64 - 8 * byteChunkSize)) << (8 * j);
+        }
+        memcpy(buffer + i, &bytes, sizeof(bytes));
+    }
+
+    readChunks(buffer + i, img + i * (8 / byteChunkSize), bufferLength - i, byteChunkSize);
+}
+
+#endif
+
+/*\
+ * Chaque version est compilée une fois par taille de byteChunk: byteChunkSize devient une constante,
+ * les branches sur le mode disparaissent et les boucles peuvent être déroulées.
+\*/
+#define SPECIALIZE_KERNEL(attributes, name, kernel) \
+    attributes static void name##Bits1(uchar* out, const uchar* in, const long length) { kernel(out, in, length, 1); } \
+    attributes static void name##Bits2(uchar* out, const uchar* in, const long length) { kernel(out, in, length, 2); } \
+    attributes static void name##Bits4(uchar* out, const uchar* in, const long length) { kernel(out, in, length, 4); } \
+    attributes static void name##Bits8(uchar* out, const uchar* in, const long length) { kernel(out, in, length, 8); }
+
+// Les versions d'un noyau, rangées par mode (byteChunkSize = 2^mode)
+#define MODE_KERNELS(name) { name##Bits1, name##Bits2, name##Bits4, name##Bits8 }
+
+#ifdef KERNELS_X86
+SPECIALIZE_KERNEL(__attribute__((target("avx2"))), embedAvx2, writeBufferToImgAvx2)
+SPECIALIZE_KERNEL(__attribute__((target("avx2"))), extractAvx2, readBufferFromImgAvx2)
+SPECIALIZE_KERNEL(__attribute__((target("bmi2"))), embedBmi2, writeBufferToImgBmi2)
+SPECIALIZE_KERNEL(__attribute__((target("bmi2"))), extractBmi2, readBufferFromImgBmi2)
+SPECIALIZE_KERNEL(__attribute__((target("sse2"))), embedSse2, writeBufferToImgSse2)
+SPECIALIZE_KERNEL(__attribute__((target("sse2"))), extractSse2, readBufferFromImgSse2)
+#endif
+SPECIALIZE_KERNEL(, embedWord, writeBufferToImgWord)
+SPECIALIZE_KERNEL(, extractWord, readBufferFromImgWord)
+SPECIALIZE_KERNEL(, embedScalar, writeChunks)
+SPECIALIZE_KERNEL(, extractScalar, readChunks)
+
+typedef struct {
+    const char* name;
+    EmbedKernel embed[4];     // Par mode
+    ExtractKernel extract[4];
+} KernelSet;
+
+/*\
+ * Les versions disponibles, dans l'ordre de préférence de chaque opération.
+ * AVX2 est la plus rapide dans tous les modes; BMI2 passe avant SSE2 car pdep / pext
+ * traitent 8 composants par instruction. La boucle simple est toujours en dernier.
+\*/
+static const KernelSet kernelSets[] = {
+#ifdef KERNELS_X86
+    { "avx2", MODE_KERNELS(embedAvx2), MODE_KERNELS(extractAvx2) },
+    { "bmi2", MODE_KERNELS(embedBmi2), MODE_KERNELS(extractBmi2) },
+    { "sse2", MODE_KERNELS(embedSse2), MODE_KERNELS(extractSse2) },
+#endif
+    { "word", MODE_KERNELS(embedWord), MODE_KERNELS(extractWord) },
+    { "scalar", MODE_KERNELS(embedScalar), MODE_KERNELS(extractScalar) },
+};
+#define KERNEL_SET_COUNT (int) (sizeof(kernelSets) / sizeof(kernelSets[0]))
+
+static int isKernelSetSupported(const KernelSet* set) {
+#ifdef KERNELS_X86
+    // __builtin_cpu_supports n'accepte que des chaînes littérales
+    __builtin_cpu_init();
+    if (strcmp(set->name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+    if (strcmp(set->name, "bmi2") == 0) return __builtin_cpu_supports("bmi2");
+    if (strcmp(set->name, "sse2") == 0) return __builtin_cpu_supports("sse2");
+#endif
+    return 1;
+}
+
+static const KernelSet* selectedSet;
+static pthread_once_t selectOnce = PTHREAD_ONCE_INIT;
+
+static void selectFirstSupported(void) {
+    selectedSet = &kernelSets[KERNEL_SET_COUNT - 1];
+    for (int i = 0; i < KERNEL_SET_COUNT; i++) {
+        if (isKernelSetSupported(&kernelSets[i])) {
+            selectedSet = &kernelSets[i];
+            return;
+        }
+    }
+}
+
+// Le choix est fait une seule fois: les appels suivants ne coûtent qu'une lecture
+static const KernelSet* selectKernelSet(void) {
+    pthread_once(&selectOnce, selectFirstSupported);
+    return selectedSet;
+}
+
+EmbedKernel embedKernel(const uchar byteChunkSizeMode) {
+    return selectKernelSet()->embed[byteChunkSizeMode];
+}
+
+ExtractKernel extractKernel(const uchar byteChunkSizeMode) {
+    return selectKernelSet()->extract[byteChunkSizeMode];
+}
+
+const char* embedKernelName(void) {
+    return selectKernelSet()->name;
+}
+
+const char* extractKernelName(void) {
+    return selectKernelSet()->name;
+}
+
+#define CHECK_LENGTH 1000 // la plus grande longueur vérifiée, en bytes
+
+/*\
+ * Vérifie chaque version disponible contre la boucle de référence, pour les 4 tailles de byteChunk,
+ * sur des données pseudo-aléatoires et des longueurs / décalages variés (pour passer par les restes).
+ * Renvoie le nombre de différences trouvées.
+\*/
+int checkKernels(void) {
+    uchar buffer[CHECK_LENGTH + 1];
+    uchar expected[CHECK_LENGTH + 1];
+    uchar result[CHECK_LENGTH + 1];
+    uchar expectedImg[8 * CHECK_LENGTH + 1];
+    uchar img[8 * CHECK_LENGTH + 1];
+    unsigned int seed = 12345;
+    int errors = 0;
+
+    for (int i = 0; i < KERNEL_SET_COUNT; i++) {
+        const KernelSet* set = &kernelSets[i];
+        if (!isKernelSetSupported(set)) continue;
+
+        for (uchar mode = 0; mode < 4; mode++) {
+            const uchar byteChunkSize = 1 << mode;
+            for (long length = 0; length <= CHECK_LENGTH; length += 1 + length / 4) {
+                for (int offset = 0; offset <= 1; offset++) {
+                    // Générateur congruentiel: les données n'ont pas besoin d'être de bonne qualité
+                    for (long j = 0; j < CHECK_LENGTH + 1; j++) buffer[j] = (seed = seed * 1103515245 + 12345) >> 16;
+                    for (long j = 0; j < 8 * CHECK_LENGTH + 1; j++) img[j] = expectedImg[j] = (seed = seed * 1103515245 + 12345) >> 16;
+
+                    writeBufferToImgScalar(expectedImg + offset, buffer + offset, length, byteChunkSize);
+                    set->embed[mode](img + offset, buffer + offset, length);
+                    if (memcmp(img, expectedImg, sizeof(img)) != 0) {
+                        fprintf(stderr, "Kernel %s: embedding mismatch (%d bit, %ld bytes)\n", set->name, byteChunkSize, length);
+                        errors++;
+                    }
+
+                    readBufferFromImgScalar(expected, img + offset, length, byteChunkSize);
+                    set->extract[mode](result, img + offset, length);
+                    if (memcmp(result, expected, length) != 0 || memcmp(expected, buffer + offset, length) != 0) {
+                        fprintf(stderr, "Kernel %s: extraction mismatch (%d bit, %ld bytes)\n", set->name, byteChunkSize, length);
+                        errors++;
+                    }
+                }
+            }
+        }
+    }
+
+    return errors;
+}
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// Le débit (en Mo du buffer par seconde) d'un noyau, mesuré pendant au moins 0.1 s
+static double measure(EmbedKernel kernel, uchar* out, const uchar* in, const long length) {
+    long rounds = 0;
+    const double start = now();
+    double elapsed;
+    do {
+        kernel(out, in, length);
+        rounds++;
+        elapsed = now() - start;
+    } while (elapsed < 0.1);
+    return rounds * (double) length / elapsed / 1e6;
+}
+
+// Les boucles de référence, avec la taille de byteChunk passée à l'exécution
+static uchar referenceByteChunkSize;
+static void embedReference(uchar* img, const uchar* buffer, const long length) {
+    writeBufferToImgScalar(img, buffer, length, referenceByteChunkSize);
+}
+static void extractReference(uchar* buffer, const uchar* img, const long length) {
+    readBufferFromImgScalar(buffer, img, length, referenceByteChunkSize);
+}
+
+void benchKernels(void) {
+    const long length = 256 * 1024; // Le buffer et l'image tiennent dans le cache L2/L3
+    uchar* buffer = malloc(length);
+    uchar* img = malloc(8 * length);
+    for (long i = 0; i < length; i++) buffer[i] = i * 2654435761u >> 24;
+    memset(img, 0x5a, 8 * length);
+
+    printf("%-8s %-4s %14s %14s\n", "kernel", "bits", "embed (MB/s)", "extract (MB/s)");
+    for (uchar mode = 0; mode < 4; mode++) {
+        referenceByteChunkSize = 1 << mode;
+        printf("%-8s %-4d %14.0f %14.0f\n", "ref", 1 << mode,
+               measure(embedReference, img, buffer, length), measure(extractReference, buffer, img, length));
+
+        for (int i = 0; i < KERNEL_SET_COUNT; i++) {
+            const KernelSet* set = &kernelSets[i];
+            if (!isKernelSetSupported(set)) continue;
+            printf("%-8s %-4d %14.0f %14.0f\n", set->name, 1 << mode,
+                   measure(set->embed[mode], img, buffer, length), measure(set->extract[mode], buffer, img, length));
+        }
+    }
+
+    free(buffer);
+    free(img);
+}
@@ -0,0 +1,40 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+typedef unsigned char uchar;
+
+/*\
+ * Noyaux d'écriture des byteChunk dans l'image.
+ * Chaque byte du buffer est découpé en (8 / byteChunkSize) byteChunk, du bit de poids fort
+ * au bit de poids faible, et chaque byteChunk remplace les derniers bits d'un composant de pixel.
+ * Noyaux de lecture: l'opération inverse. Les derniers bits de (8 / byteChunkSize) composants de pixel
+ * sont rassemblés dans chaque byte du buffer, qui n'a pas besoin d'être initialisé: tous ses bytes sont écrits.
+ *
+ * Il existe plusieurs versions (AVX2, BMI2, SSE2, mot par mot ou la boucle de référence), qui produisent
+ * exactement le même résultat; la plus rapide supportée par le processeur est choisie une fois, à la première utilisation.
+ * Chaque version existe en 4 exemplaires, un par mode (byteChunkSize = 2^mode), où la taille des byteChunk
+ * est une constante. Le mode lu dans les 2 premiers composants de l'image donne directement le noyau à utiliser,
+ * sans rien choisir à chaque appel.
+\*/
+typedef void (*EmbedKernel)(uchar* img, const uchar* buffer, const long bufferLength);
+typedef void (*ExtractKernel)(uchar* buffer, const uchar* img, const long bufferLength);
+
+// Les noyaux de la version choisie pour ce processeur, pour le mode byteChunkSizeMode (0 à 3)
+EmbedKernel embedKernel(const uchar byteChunkSizeMode);
+ExtractKernel extractKernel(const uchar byteChunkSizeMode);
+
+// Le nom de la version choisie pour ce processeur (la même pour les deux)
+const char* embedKernelName(void);
+const char* extractKernelName(void);
+
+// Les boucles de référence, un composant de pixel à la fois, pour n'importe quel byteChunkSize
+void writeBufferToImgScalar(uchar* img, const uchar* buffer, const long bufferLength, const uchar byteChunkSize);
+void readBufferFromImgScalar(uchar* buffer, const uchar* img, const long bufferLength, const uchar byteChunkSize);
+
+// Vérifie toutes les versions disponibles contre les boucles de référence; renvoie le nombre d'erreurs
+int checkKernels(void);
+
+// Affiche le débit de chaque version dans chaque mode, comparé aux boucles de référence
+void benchKernels(void);
+
+#endif
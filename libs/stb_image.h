@@ -501,6 +501,35 @@ STBIDEF int      stbi_is_16_bit          (char const *filename);
 STBIDEF int      stbi_is_16_bit_from_file(FILE *f);
 #endif
 
+#if !defined(STBI_NO_PNG) && !defined(STBI_NO_STDIO)
+// decode a PNG one row at a time: callback receives each row (converted to desired_channels
+// 8-bit components) in order, may modify it, and returns 0 to stop decoding there. *x, *y and *channels_in_file
+// are set before the first call. Only 8-bit non-interlaced PNGs are supported; returns 1 if
+// decoding reached the last row or was stopped by callback, 0 on failure
+typedef int stbi_png_row_callback(void *user, stbi_uc *row, int y);
+STBIDEF int      stbi_png_load_rows      (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels, stbi_png_row_callback *callback, void *user);
+
+// undo the PNG filter (0-4) of one 8-bit row of length bytes in place, prior being the previous
+// defiltered row (0s for the first one); with use_simd, the SSE2/AVX2 routines are used when available
+// (3 and 4 channels). Mostly useful to check those routines against the scalar loops
+STBIDEF void     stbi_png_defilter_row   (stbi_uc *row, stbi_uc const *prior, int filter, int channels, int length, int use_simd);
+
+// decode the scanlines of a PNG without defiltering them, e.g. to re-encode only its start: raw
+// receives the zlib-decompressed data in order (each scanline is its filter byte then the filtered
+// bytes), and block is called before each deflate block with the number of decompressed bytes before
+// it and the position of its first bit in the compressed data, counted from the first byte of the
+// first IDAT chunk with the IDAT chunks concatenated (bit 0 is the least significant bit of that byte).
+// Either callback returns 0 to stop decoding; block may be NULL. *channels_in_file is 1 for paletted
+// PNGs. Same limits as stbi_png_load_rows; returns 1 if decoding reached the end of the data or was
+// stopped, 0 on failure
+typedef struct
+{
+   int (*raw)(void *user, stbi_uc const *data, int len);
+   int (*block)(void *user, long long raw_offset, long long bit_offset);
+} stbi_png_raw_callbacks;
+STBIDEF int      stbi_png_load_raw       (char const *filename, int *x, int *y, int *channels_in_file, stbi_png_raw_callbacks const *callbacks, void *user);
+#endif
+
 
 
 // for image formats that explicitly notate that they have premultiplied alpha,
@@ -532,6 +561,11 @@ STBIDEF int   stbi_zlib_decode_buffer(char *obuffer, int olen, const char *ibuff
 STBIDEF char *stbi_zlib_decode_noheader_malloc(const char *buffer, int len, int *outlen);
 STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const char *ibuffer, int ilen);
 
+// the zlib decoder uses a faster inflate loop (64-bit bit buffer, two literals per lookup, wide
+// match copies) whenever enough input and output are available; flag 0 keeps the byte-at-a-time
+// decoder only, e.g. to check one against the other. Not thread-safe: set it before decoding
+STBIDEF void  stbi_zlib_set_fast_inflate(int flag_true_if_should_use_fast_inflate);
+
 
 #ifdef __cplusplus
 }
@@ -1750,9 +1784,11 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 #if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
 // nothing
 #else
+static int stbi__convert_row(unsigned char *src, int img_n, unsigned char *dest, int req_comp, unsigned int x);
+
 static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
-   int i,j;
+   int j;
    unsigned char *good;
 
    if (req_comp == img_n) return data;
@@ -1765,9 +1801,18 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
    }
 
    for (j=0; j < (int) y; ++j) {
-      unsigned char *src  = data + j * x * img_n   ;
-      unsigned char *dest = good + j * x * req_comp;
+      if (!stbi__convert_row(data + j * x * img_n, img_n, good + j * x * req_comp, req_comp, x)) {
+         STBI_FREE(data); STBI_FREE(good); return stbi__errpuc("unsupported", "Unsupported format conversion");
+      }
+   }
+
+   STBI_FREE(data);
+   return good;
+}
 
+static int stbi__convert_row(unsigned char *src, int img_n, unsigned char *dest, int req_comp, unsigned int x)
+{
+      int i;
       #define STBI__COMBO(a,b)  ((a)*8+(b))
       #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
       // convert source image with img_n components to one with req_comp components;
@@ -1785,13 +1830,10 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
          STBI__CASE(4,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
          STBI__CASE(4,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = src[3]; } break;
          STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                    } break;
-         default: STBI_ASSERT(0); STBI_FREE(data); STBI_FREE(good); return stbi__errpuc("unsupported", "Unsupported format conversion");
+         default: STBI_ASSERT(0); return 0;
       }
       #undef STBI__CASE
-   }
-
-   STBI_FREE(data);
-   return good;
+      return 1;
 }
 #endif
 
@@ -4089,6 +4131,8 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 #define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
+#define STBI__ZPAIR_BITS  12 // two literals are decoded at once when their codes fit in this many bits
+#define STBI__ZPAIR_MASK  ((1 << STBI__ZPAIR_BITS) - 1)
 
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
@@ -4183,12 +4227,31 @@ typedef struct
    char *zout_end;
    int   z_expandable;
 
+   // streamed decoding (stbi__do_zlib_stream): input is read on demand with refill, and the
+   // output is handed to sink whenever the buffer is full, keeping only the last 32K as the window
+   int (*refill)(void *user, stbi_uc **start, stbi_uc **end);
+   int (*sink)(void *user, stbi_uc *data, int len);
+   int (*block)(void *user);   // optional: called before each block, once the output before it went to sink
+   void *stream_user;
+   char *zout_flushed;
+
    stbi__zhuffman z_length, z_distance;
+   // z_pairs[bits]: two literals (bits 0-15) and their total code length (bits 16-23), or 0 if the
+   // bits don't start with two literal codes; built from z_length for the fast inflate loop
+   stbi__uint32 z_pairs[1 << STBI__ZPAIR_BITS];
 } stbi__zbuf;
 
+static int stbi__zfast_inflate = 1;
+
+STBIDEF void stbi_zlib_set_fast_inflate(int flag_true_if_should_use_fast_inflate)
+{
+   stbi__zfast_inflate = flag_true_if_should_use_fast_inflate;
+}
+
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
 {
-   return (z->zbuffer >= z->zbuffer_end);
+   if (z->zbuffer < z->zbuffer_end) return 0;
+   return z->refill == NULL || !z->refill(z->stream_user, &z->zbuffer, &z->zbuffer_end);
 }
 
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
@@ -4201,6 +4264,7 @@ static void stbi__fill_bits(stbi__zbuf *z)
    do {
       if (z->code_buffer >= (1U << z->num_bits)) {
         z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
+        z->refill = NULL;
         return;
       }
       z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
@@ -4218,12 +4282,14 @@ stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
    return k;
 }
 
-static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+// decode the code at the bottom of bits (at least 16 of them), not resolved by the fast table;
+// returns the symbol and its code length in *size, or -1
+static int stbi__zhuffman_decode_bits(stbi__zhuffman *z, unsigned int bits, int *size)
 {
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse(bits & 0xffff, 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -4232,9 +4298,18 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
    if (b >= STBI__ZNSYMS) return -1; // some data was corrupt somewhere!
    if (z->size[b] != s) return -1;  // was originally an assert, but report failure instead.
+   *size = s;
+   return z->value[b];
+}
+
+static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+{
+   int s;
+   int v = stbi__zhuffman_decode_bits(z, a->code_buffer, &s);
+   if (v < 0) return -1;
    a->code_buffer >>= s;
    a->num_bits -= s;
-   return z->value[b];
+   return v;
 }
 
 stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
@@ -4256,11 +4331,30 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
    return stbi__zhuffman_decode_slowpath(a, z);
 }
 
+#define STBI__ZWINDOW   32768
+#define STBI__ZSTREAM   (128*1024)   // output decoded between two calls to the sink
+
+static int stbi__zflush(stbi__zbuf *z, int n)  // hand the new output to the sink, then make room for n bytes
+{
+   char *keep;
+   if (z->zout > z->zout_flushed)
+      if (!z->sink(z->stream_user, (stbi_uc *) z->zout_flushed, (int) (z->zout - z->zout_flushed)))
+         return 0;
+   // later matches can reach up to 32K back, so slide that much to the start of the buffer
+   keep = z->zout - z->zout_start > STBI__ZWINDOW ? z->zout - STBI__ZWINDOW : z->zout_start;
+   memmove(z->zout_start, keep, z->zout - keep);
+   z->zout = z->zout_start + (z->zout - keep);
+   z->zout_flushed = z->zout;
+   if (z->zout + n > z->zout_end) return stbi__err("output buffer limit","Corrupt PNG");
+   return 1;
+}
+
 static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room for n bytes
 {
    char *q;
    unsigned int cur, limit, old_limit;
    z->zout = zout;
+   if (z->sink) return stbi__zflush(z, n);
    if (!z->z_expandable) return stbi__err("output buffer limit","Corrupt PNG");
    cur   = (unsigned int) (z->zout - z->zout_start);
    limit = old_limit = (unsigned) (z->zout_end - z->zout_start);
@@ -4292,11 +4386,177 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+// fill z_pairs from the fast table of z_length
+static void stbi__zbuild_pairs(stbi__zbuf *a)
+{
+   int j;
+   for (j=0; j < (1 << STBI__ZPAIR_BITS); ++j) {
+      int first = a->z_length.fast[j & STBI__ZFAST_MASK], second, s;
+      a->z_pairs[j] = 0;
+      if (first == 0 || (first & 511) >= 256) continue;
+      s = first >> 9;
+      // the second code must fit in the bits left, the fast table would read 0s past them
+      second = a->z_length.fast[(j >> s) & STBI__ZFAST_MASK];
+      if (second == 0 || (second & 511) >= 256 || s + (second >> 9) > STBI__ZPAIR_BITS) continue;
+      a->z_pairs[j] = (stbi__uint32) ((first & 255) | (second & 255) << 8 | (s + (second >> 9)) << 16);
+   }
+}
+
+stbi_inline static unsigned long long stbi__zload64(const stbi_uc *p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   unsigned long long v;
+   memcpy(&v, p, 8);
+   return v;
+#else
+   unsigned long long v = 0;
+   int i;
+   for (i=7; i >= 0; --i) v = v << 8 | p[i];
+   return v;
+#endif
+}
+
+// the output may be written up to this many bytes past the end of a match (wide copies)
+#define STBI__ZCOPY_OVERRUN 16
+
+/*
+ * Fast inflate loop: decodes symbols while at least 8 bytes of input and room for a maximal match
+ * (plus the copy overrun) are available, then hands back to stbi__parse_huffman_block. The bit
+ * buffer is refilled 8 bytes at a time to 56-63 bits, enough for a length and a distance with
+ * their extra bits, so there's at most one refill per symbol. Bytes of the refill that were not
+ * used are given back on exit, so the byte-at-a-time code sees at most 32 bits in code_buffer.
+ * Returns 0 on error, 1 otherwise with *end_of_block set when code 256 was decoded.
+ */
+static int stbi__parse_huffman_fast(stbi__zbuf *a, char **pzout, int *end_of_block)
+{
+   unsigned long long bits = a->code_buffer;
+   int num_bits = a->num_bits;
+   stbi_uc *in = a->zbuffer, *in_start = a->zbuffer;
+   char *zout = *pzout;
+   int ok = 1, unused;
+
+   while (a->zbuffer_end - in >= 8 && a->zout_end - zout >= 258 + STBI__ZCOPY_OVERRUN) {
+      stbi__uint32 pair;
+      int z, s, len, dist;
+      stbi_uc *p;
+      char *end;
+
+      bits |= stbi__zload64(in) << num_bits;
+      in += (63 - num_bits) >> 3;
+      num_bits |= 56;
+
+      pair = a->z_pairs[bits & STBI__ZPAIR_MASK];
+      if (pair) {
+         zout[0] = (char) pair;
+         zout[1] = (char) (pair >> 8);
+         zout += 2;
+         s = pair >> 16;
+         bits >>= s;
+         num_bits -= s;
+         continue;
+      }
+
+      z = a->z_length.fast[bits & STBI__ZFAST_MASK];
+      if (z) {
+         s = z >> 9;
+         z &= 511;
+      } else {
+         z = stbi__zhuffman_decode_bits(&a->z_length, (unsigned int) bits, &s);
+         if (z < 0) { ok = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      }
+      bits >>= s;
+      num_bits -= s;
+      if (z < 256) {
+         *zout++ = (char) z;
+         continue;
+      }
+      if (z == 256) {
+         *end_of_block = 1;
+         break;
+      }
+      if (z >= 286) { ok = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      z -= 257;
+      len = stbi__zlength_base[z];
+      s = stbi__zlength_extra[z];
+      len += (int) (bits & ((1 << s) - 1));
+      bits >>= s;
+      num_bits -= s;
+
+      z = a->z_distance.fast[bits & STBI__ZFAST_MASK];
+      if (z) {
+         s = z >> 9;
+         z &= 511;
+      } else {
+         z = stbi__zhuffman_decode_bits(&a->z_distance, (unsigned int) bits, &s);
+         if (z < 0) { ok = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      }
+      if (z >= 30) { ok = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      bits >>= s;
+      num_bits -= s;
+      dist = stbi__zdist_base[z];
+      s = stbi__zdist_extra[z];
+      dist += (int) (bits & ((1 << s) - 1));
+      bits >>= s;
+      num_bits -= s;
+      if (zout - a->zout_start < dist) { ok = stbi__err("bad dist","Corrupt PNG"); break; }
+
+      // wide copies may write past the end of the match, the next symbols overwrite it
+      p = (stbi_uc *) (zout - dist);
+      end = zout + len;
+      if (dist >= 16) {
+         // each copy only reads bytes already written
+         do {
+            memcpy(zout, p, 16);
+            zout += 16;
+            p += 16;
+         } while (zout < end);
+      } else if (dist >= 8) {
+         do {
+            memcpy(zout, p, 8);
+            zout += 8;
+            p += 8;
+         } while (zout < end);
+      } else if (dist == 1) {
+         memset(zout, *p, len);
+      } else {
+         // 8 bytes of the pattern, advancing by whole repetitions of it
+         stbi_uc pattern[8];
+         int step = 8 - 8 % dist, i;
+         for (i=0; i < 8; ++i) pattern[i] = p[i % dist];
+         do {
+            memcpy(zout, pattern, 8);
+            zout += step;
+         } while (zout < end);
+      }
+      zout = end;
+   }
+
+   // give back the whole bytes of the last refills that were not used
+   unused = num_bits >> 3;
+   if (unused > in - in_start) unused = (int) (in - in_start);
+   in -= unused;
+   num_bits -= unused * 8;
+   a->zbuffer = in;
+   a->num_bits = num_bits;
+   a->code_buffer = (stbi__uint32) (bits & ((1ULL << num_bits) - 1));
+   *pzout = zout;
+   return ok;
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+      if (stbi__zfast_inflate && a->zbuffer_end - a->zbuffer >= 8 && a->zout_end - zout >= 258 + STBI__ZCOPY_OVERRUN) {
+         int end_of_block = 0;
+         if (!stbi__parse_huffman_fast(a, &zout, &end_of_block)) return 0;
+         if (end_of_block) {
+            a->zout = zout;
+            return 1;
+         }
+      }
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -4405,9 +4665,18 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
-   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
+   if (a->refill == NULL && a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    if (a->zout + len > a->zout_end)
       if (!stbi__zexpand(a, a->zout, len)) return 0;
+   while (a->zbuffer + len > a->zbuffer_end) {
+      // streamed input: copy what is buffered, then read more
+      k = (int) (a->zbuffer_end - a->zbuffer);
+      memcpy(a->zout, a->zbuffer, k);
+      a->zbuffer += k;
+      a->zout += k;
+      len -= k;
+      if (stbi__zeof(a)) return stbi__err("read past buffer","Corrupt PNG");
+   }
    memcpy(a->zout, a->zbuffer, len);
    a->zbuffer += len;
    a->zout += len;
@@ -4465,6 +4734,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
    a->num_bits = 0;
    a->code_buffer = 0;
    do {
+      if (a->block && (!stbi__zflush(a, 0) || !a->block(a->stream_user))) return 0;
       final = stbi__zreceive(a,1);
       type = stbi__zreceive(a,2);
       if (type == 0) {
@@ -4479,6 +4749,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
+         if (stbi__zfast_inflate) stbi__zbuild_pairs(a);
          if (!stbi__parse_huffman_block(a)) return 0;
       }
    } while (!final);
@@ -4491,10 +4762,33 @@ static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse
    a->zout       = obuf;
    a->zout_end   = obuf + olen;
    a->z_expandable = exp;
+   a->refill = NULL;
+   a->sink = NULL;
+   a->block = NULL;
 
    return stbi__parse_zlib(a, parse_header);
 }
 
+// obuf must hold STBI__ZWINDOW + STBI__ZSTREAM bytes; zbuffer can start empty, refill is called for input.
+// returns 0 on failure, or when the sink stopped the decoding
+static int stbi__do_zlib_stream(stbi__zbuf *a, char *obuf, int parse_header,
+                                int (*refill)(void *, stbi_uc **, stbi_uc **), int (*sink)(void *, stbi_uc *, int),
+                                int (*block)(void *), void *user)
+{
+   a->zout_start = obuf;
+   a->zout       = obuf;
+   a->zout_end   = obuf + STBI__ZWINDOW + STBI__ZSTREAM;
+   a->zout_flushed = obuf;
+   a->z_expandable = 0;
+   a->refill = refill;
+   a->sink = sink;
+   a->block = block;
+   a->stream_user = user;
+
+   if (!stbi__parse_zlib(a, parse_header)) return 0;
+   return stbi__zflush(a, 0);
+}
+
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen)
 {
    stbi__zbuf a;
@@ -4644,6 +4938,135 @@ static int stbi__paeth(int a, int b, int c)
    return c;
 }
 
+#ifdef STBI_SSE2
+// SIMD defiltering of 8-bit rows. Sub, Average and Paeth depend on the pixel just decoded to its
+// left, so they work on one 3- or 4-byte pixel per register (Paeth in 16-bit lanes). Up has no such
+// dependency and works on 16 bytes at a time, or 32 with AVX2 (checked at run time, gcc/clang only).
+// raw and cur may be the same row.
+
+#if defined(__GNUC__) && !defined(STBI_NO_PNG_AVX2)
+#include <immintrin.h>
+#define STBI__PNG_AVX2
+
+__attribute__((target("avx2")))
+static stbi__uint32 stbi__png_defilter_up_avx2(stbi_uc *cur, stbi_uc const *raw, stbi_uc const *prior, stbi__uint32 len)
+{
+   stbi__uint32 i;
+   for (i=0; i + 32 <= len; i += 32) {
+      __m256i x = _mm256_add_epi8(_mm256_loadu_si256((__m256i const *) (raw+i)), _mm256_loadu_si256((__m256i const *) (prior+i)));
+      _mm256_storeu_si256((__m256i *) (cur+i), x);
+   }
+   return i;
+}
+#endif
+
+// pixels are loaded 4 bytes at a time: with 3 channels, the 4th lane holds the next pixel and is never
+// stored (except for the last pixel of the row). 3-byte pixels are stored as 2 + 1 bytes, so that the
+// next loads never overlap a store, which would stall store-to-load forwarding
+static __m128i stbi__png_load_pixel(stbi_uc const *p, int whole)
+{
+   stbi__uint32 v;
+   if (whole) {
+      memcpy(&v, p, 4);
+   } else {
+      stbi__uint16 lo;
+      memcpy(&lo, p, 2);
+      v = lo | (stbi__uint32) p[2] << 16;
+   }
+   return _mm_cvtsi32_si128((int) v);
+}
+
+static void stbi__png_store_pixel(stbi_uc *p, __m128i x, int n)
+{
+   stbi__uint32 v = (stbi__uint32) _mm_cvtsi128_si32(x);
+   if (n == 4) {
+      memcpy(p, &v, 4);
+   } else {
+      stbi__uint16 lo = (stbi__uint16) v;
+      memcpy(p, &lo, 2);
+      p[2] = (stbi_uc) (v >> 16);
+   }
+}
+
+static __m128i stbi__png_abs_epi16(__m128i x)
+{
+   return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static __m128i stbi__png_select(__m128i mask, __m128i a, __m128i b)
+{
+   return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// returns 0 if the row must be defiltered by the scalar loops
+static int stbi__png_defilter_simd(stbi_uc *cur, stbi_uc const *raw, stbi_uc const *prior, int filter, int n, stbi__uint32 len)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i a, b, c, x;
+   stbi__uint32 i = 0;
+
+   if (filter == STBI__F_up) {
+      #ifdef STBI__PNG_AVX2
+      if (__builtin_cpu_supports("avx2")) i = stbi__png_defilter_up_avx2(cur, raw, prior, len);
+      #endif
+      for (   ; i + 16 <= len; i += 16) {
+         x = _mm_add_epi8(_mm_loadu_si128((__m128i const *) (raw+i)), _mm_loadu_si128((__m128i const *) (prior+i)));
+         _mm_storeu_si128((__m128i *) (cur+i), x);
+      }
+      for (   ; i < len; ++i) cur[i] = STBI__BYTECAST(raw[i] + prior[i]);
+      return 1;
+   }
+   if ((n != 3 && n != 4) || len % n != 0) return 0;
+
+   switch (filter) {
+      case STBI__F_none:
+         if (cur != raw) memcpy(cur, raw, len);
+         return 1;
+      case STBI__F_sub:
+         a = zero;
+         for (i=0; i < len; i += n) {
+            int whole = i + 4 <= len;
+            a = _mm_add_epi8(stbi__png_load_pixel(raw+i, whole), a);
+            stbi__png_store_pixel(cur+i, a, n);
+         }
+         return 1;
+      case STBI__F_avg:
+         // _mm_avg_epu8 rounds up, the filter rounds down
+         a = zero;
+         for (i=0; i < len; i += n) {
+            int whole = i + 4 <= len;
+            b = stbi__png_load_pixel(prior+i, whole);
+            x = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+            a = _mm_add_epi8(stbi__png_load_pixel(raw+i, whole), x);
+            stbi__png_store_pixel(cur+i, a, n);
+         }
+         return 1;
+      case STBI__F_paeth:
+         // p = a+b-c, so |p-a| = |b-c|, |p-b| = |a-c| and |p-c| = |(b-c) + (a-c)|
+         a = c = zero;
+         for (i=0; i < len; i += n) {
+            __m128i pa, pb, pc, smallest, nearest;
+            int whole = i + 4 <= len;
+            b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior+i, whole), zero);
+            pa = _mm_sub_epi16(b, c);
+            pb = _mm_sub_epi16(a, c);
+            pc = stbi__png_abs_epi16(_mm_add_epi16(pa, pb));
+            pa = stbi__png_abs_epi16(pa);
+            pb = stbi__png_abs_epi16(pb);
+            smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            nearest = stbi__png_select(_mm_cmpeq_epi16(smallest, pa), a,
+                      stbi__png_select(_mm_cmpeq_epi16(smallest, pb), b, c));
+            x = _mm_add_epi8(stbi__png_load_pixel(raw+i, whole), _mm_packus_epi16(nearest, nearest));
+            stbi__png_store_pixel(cur+i, x, n);
+            a = _mm_unpacklo_epi8(x, zero);
+            c = b;
+         }
+         return 1;
+   }
+   return 0;
+}
+#endif // STBI_SSE2
+
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
 // create the png data from post-deflated data
@@ -4692,6 +5115,14 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
 
+      #ifdef STBI_SSE2
+      // the special first row filters are left to the scalar loops
+      if (depth == 8 && img_n == out_n && j > 0 && stbi__png_defilter_simd(cur, raw, prior, filter, img_n, x*img_n)) {
+         raw += x*img_n;
+         continue;
+      }
+      #endif
+
       // handle first byte explicitly
       for (k=0; k < filter_bytes; ++k) {
          switch (filter) {
@@ -5119,12 +5550,13 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             if (!s->img_x || !s->img_y) return stbi__err("0-pixel image","Corrupt PNG");
             if (!pal_img_n) {
                s->img_n = (color & 2 ? 3 : 1) + (color & 4 ? 1 : 0);
-               if ((1 << 30) / s->img_x / s->img_n < s->img_y) return stbi__err("too large", "Image too large to decode");
+               // a header-only scan (stbi_info) allocates nothing, and larger images can be decoded by rows
+               if (scan != STBI__SCAN_header && (1 << 30) / s->img_x / s->img_n < s->img_y) return stbi__err("too large", "Image too large to decode");
             } else {
                // if paletted, then pal_n is our final components, and
                // img_n is # components to decompress/filter.
                s->img_n = 1;
-               if ((1 << 30) / s->img_x / 4 < s->img_y) return stbi__err("too large","Corrupt PNG");
+               if (scan != STBI__SCAN_header && (1 << 30) / s->img_x / 4 < s->img_y) return stbi__err("too large","Corrupt PNG");
             }
             // even with SCAN_header, have to scan to see if we have a tRNS
             break;
@@ -5339,6 +5771,319 @@ static int stbi__png_is16(stbi__context *s)
 }
 #endif
 
+#if !defined(STBI_NO_PNG) && !defined(STBI_NO_STDIO)
+// row-by-row PNG decoding: the IDAT chunks are read as the inflater needs them,
+// and each decoded scanline is defiltered and handed to the callback right away
+
+typedef struct
+{
+   stbi__context *s;
+   stbi__uint32 idat_left;          // bytes of the current IDAT chunk not read yet
+   stbi_uc in[65536];
+
+   stbi__uint32 x, y, row;
+   int img_n, out_n, req_comp;
+   stbi_uc *palette;                 // NULL unless color type 3
+   stbi__uint32 raw_len, raw_fill;   // a scanline is 1 filter byte + raw_len - 1 bytes
+   stbi_uc *cur, *prior, *expanded, *out;
+   int stopped;
+
+   stbi_png_row_callback *callback;
+   stbi_png_raw_callbacks const *raw; // stbi_png_load_raw: the data goes to raw->raw instead of being defiltered
+   stbi__zbuf *z;
+   long long total_in, total_out;     // bytes given to the inflater, and handed to raw->raw
+   void *user;
+} stbi__png_rows;
+
+static int stbi__png_rows_refill(void *user, stbi_uc **start, stbi_uc **end)
+{
+   stbi__png_rows *p = (stbi__png_rows *) user;
+   stbi__uint32 n;
+   while (p->idat_left == 0) {
+      stbi__pngchunk c;
+      stbi__get32be(p->s); // CRC of the previous IDAT
+      c = stbi__get_chunk_header(p->s);
+      if (c.type != STBI__PNG_TYPE('I','D','A','T')) return 0; // end of the image data
+      p->idat_left = c.length;
+   }
+   n = p->idat_left < sizeof(p->in) ? p->idat_left : (stbi__uint32) sizeof(p->in);
+   if (!stbi__getn(p->s, p->in, n)) return 0;
+   p->idat_left -= n;
+   p->total_in += n;
+   *start = p->in;
+   *end = p->in + n;
+   return 1;
+}
+
+static void stbi__png_defilter_row_scalar(stbi_uc *cur, stbi_uc const *prior, int filter, int n, stbi__uint32 len)
+{
+   // prior is a row of 0s for the first scanline, so no special first-row filters are needed
+   stbi__uint32 i;
+   switch (filter) {
+      case STBI__F_none:
+         break;
+      case STBI__F_sub:
+         for (i=n; i < len; ++i) cur[i] = STBI__BYTECAST(cur[i] + cur[i-n]);
+         break;
+      case STBI__F_up:
+         for (i=0; i < len; ++i) cur[i] = STBI__BYTECAST(cur[i] + prior[i]);
+         break;
+      case STBI__F_avg:
+         for (i=0; i < (stbi__uint32) n; ++i) cur[i] = STBI__BYTECAST(cur[i] + (prior[i]>>1));
+         for (   ; i < len; ++i) cur[i] = STBI__BYTECAST(cur[i] + ((prior[i] + cur[i-n])>>1));
+         break;
+      case STBI__F_paeth:
+         for (i=0; i < (stbi__uint32) n; ++i) cur[i] = STBI__BYTECAST(cur[i] + prior[i]);
+         for (   ; i < len; ++i) cur[i] = STBI__BYTECAST(cur[i] + stbi__paeth(cur[i-n], prior[i], prior[i-n]));
+         break;
+   }
+}
+
+static void stbi__png_defilter_row(stbi_uc *cur, stbi_uc const *prior, int filter, int n, stbi__uint32 len)
+{
+   #ifdef STBI_SSE2
+   if (stbi__png_defilter_simd(cur, cur, prior, filter, n, len)) return;
+   #endif
+   stbi__png_defilter_row_scalar(cur, prior, filter, n, len);
+}
+
+STBIDEF void stbi_png_defilter_row(stbi_uc *row, stbi_uc const *prior, int filter, int channels, int length, int use_simd)
+{
+   if (use_simd)
+      stbi__png_defilter_row(row, prior, filter, channels, length);
+   else
+      stbi__png_defilter_row_scalar(row, prior, filter, channels, length);
+}
+
+static int stbi__png_rows_sink(void *user, stbi_uc *data, int len)
+{
+   stbi__png_rows *p = (stbi__png_rows *) user;
+   while (len > 0) {
+      stbi__uint32 n = p->raw_len - p->raw_fill;
+      stbi_uc *pixels, *t;
+      if (n > (stbi__uint32) len) n = len;
+      memcpy(p->cur + p->raw_fill, data, n);
+      p->raw_fill += n;
+      data += n;
+      len -= n;
+      if (p->raw_fill < p->raw_len) break;
+
+      if (p->cur[0] > 4) return stbi__err("invalid filter","Corrupt PNG");
+      stbi__png_defilter_row(p->cur+1, p->prior+1, p->cur[0], p->img_n, p->raw_len-1);
+      pixels = p->cur+1;
+      if (p->palette) {
+         stbi__uint32 i;
+         for (i=0; i < p->x; ++i)
+            memcpy(p->expanded + i*p->out_n, p->palette + pixels[i]*4, p->out_n);
+         pixels = p->expanded;
+      }
+      if (p->req_comp != p->out_n) {
+         if (!stbi__convert_row(pixels, p->out_n, p->out, p->req_comp, p->x)) return stbi__err("unsupported", "Unsupported format conversion");
+         pixels = p->out;
+      } else if (pixels == p->cur+1) {
+         memcpy(p->out, pixels, p->x * p->out_n); // the callback may modify row, cur becomes the prior scanline
+         pixels = p->out;
+      }
+
+      t = p->prior; p->prior = p->cur; p->cur = t;
+      p->raw_fill = 0;
+      if (!p->callback(p->user, pixels, p->row++) || p->row == p->y) {
+         p->stopped = 1;
+         return 0;
+      }
+   }
+   return 1;
+}
+
+static int stbi__png_raw_sink(void *user, stbi_uc *data, int len)
+{
+   stbi__png_rows *p = (stbi__png_rows *) user;
+   p->total_out += len;
+   if (!p->raw->raw(p->user, data, len)) {
+      p->stopped = 1;
+      return 0;
+   }
+   return 1;
+}
+
+static int stbi__png_raw_block(void *user)
+{
+   stbi__png_rows *p = (stbi__png_rows *) user;
+   // the bits of the bytes read, minus those not consumed yet: the bytes left and the bit buffer
+   long long bit = (p->total_in - (p->z->zbuffer_end - p->z->zbuffer)) * 8 - p->z->num_bits;
+   if (!p->raw->block(p->user, p->total_out, bit)) {
+      p->stopped = 1;
+      return 0;
+   }
+   return 1;
+}
+
+static int stbi__png_load_rows_main(stbi__png_rows *p, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context *s = p->s;
+   stbi_uc palette[1024];
+   stbi__uint32 i, pal_len=0;
+   int first=1, color=0, depth=0, interlace=0, pal_img_n=0;
+   stbi__zbuf a;
+   stbi_uc *rows;
+   char *zout;
+
+   if (req_comp < 0 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+   if (!stbi__check_png_header(s)) return 0;
+
+   for (;;) {
+      stbi__pngchunk c = stbi__get_chunk_header(s);
+      switch (c.type) {
+         case STBI__PNG_TYPE('C','g','B','I'):
+            return stbi__err("iphone png", "PNG not supported: iPhone PNG");
+
+         case STBI__PNG_TYPE('I','H','D','R'): {
+            if (!first) return stbi__err("multiple IHDR","Corrupt PNG");
+            first = 0;
+            if (c.length != 13) return stbi__err("bad IHDR len","Corrupt PNG");
+            s->img_x = stbi__get32be(s);
+            s->img_y = stbi__get32be(s);
+            if (s->img_y > STBI_MAX_DIMENSIONS) return stbi__err("too large","Very large image (corrupt?)");
+            if (s->img_x > STBI_MAX_DIMENSIONS) return stbi__err("too large","Very large image (corrupt?)");
+            depth = stbi__get8(s);
+            color = stbi__get8(s);  if (color > 6 || (color & 1 && color != 3)) return stbi__err("bad ctype","Corrupt PNG");
+            if (stbi__get8(s)) return stbi__err("bad comp method","Corrupt PNG");
+            if (stbi__get8(s)) return stbi__err("bad filter method","Corrupt PNG");
+            interlace = stbi__get8(s);
+            if (depth != 8) return stbi__err("8-bit only","PNG not supported: row decoding is 8-bit only");
+            if (interlace) return stbi__err("interlaced","PNG not supported: row decoding of interlaced PNG");
+            if (!s->img_x || !s->img_y) return stbi__err("0-pixel image","Corrupt PNG");
+            if (color == 3) pal_img_n = 3;
+            s->img_n = color == 3 ? 1 : (color & 2 ? 3 : 1) + (color & 4 ? 1 : 0);
+            break;
+         }
+
+         case STBI__PNG_TYPE('P','L','T','E'):
+            if (first) return stbi__err("first not IHDR", "Corrupt PNG");
+            if (c.length > 256*3) return stbi__err("invalid PLTE","Corrupt PNG");
+            pal_len = c.length / 3;
+            if (pal_len * 3 != c.length) return stbi__err("invalid PLTE","Corrupt PNG");
+            memset(palette, 0, sizeof(palette));
+            for (i=0; i < pal_len; ++i) {
+               palette[i*4+0] = stbi__get8(s);
+               palette[i*4+1] = stbi__get8(s);
+               palette[i*4+2] = stbi__get8(s);
+               palette[i*4+3] = 255;
+            }
+            break;
+
+         case STBI__PNG_TYPE('t','R','N','S'):
+            if (first) return stbi__err("first not IHDR", "Corrupt PNG");
+            if (!pal_img_n) return stbi__err("tRNS", "PNG not supported: row decoding has no color key transparency");
+            if (pal_len == 0) return stbi__err("tRNS before PLTE","Corrupt PNG");
+            if (c.length > pal_len) return stbi__err("bad tRNS len","Corrupt PNG");
+            pal_img_n = 4;
+            for (i=0; i < c.length; ++i)
+               palette[i*4+3] = stbi__get8(s);
+            break;
+
+         case STBI__PNG_TYPE('I','D','A','T'):
+            if (first) return stbi__err("first not IHDR", "Corrupt PNG");
+            if (pal_img_n && !pal_len) return stbi__err("no PLTE","Corrupt PNG");
+            p->idat_left = c.length;
+            goto decode;
+
+         case STBI__PNG_TYPE('I','E','N','D'):
+            return stbi__err("no IDAT","Corrupt PNG");
+
+         default:
+            if (first) return stbi__err("first not IHDR", "Corrupt PNG");
+            if ((c.type & (1 << 29)) == 0) return stbi__err("unknown chunk", "PNG not supported: unknown PNG chunk type");
+            stbi__skip(s, c.length);
+            break;
+      }
+      // end of PNG chunk, read and skip CRC
+      stbi__get32be(s);
+   }
+
+decode:
+   p->x = s->img_x;
+   p->y = s->img_y;
+   p->row = 0;
+   p->img_n = s->img_n;
+   p->out_n = pal_img_n ? pal_img_n : s->img_n;
+   p->req_comp = req_comp ? req_comp : p->out_n;
+   p->palette = pal_img_n ? palette : NULL;
+   p->raw_len = p->x * s->img_n + 1;
+   p->raw_fill = 0;
+   p->stopped = 0;
+   *x = s->img_x;
+   *y = s->img_y;
+   if (comp) *comp = p->raw ? s->img_n : p->out_n;
+
+   rows = (stbi_uc *) stbi__malloc_mad2(p->raw_len, 2, 0); // cur and prior, swapped after each scanline
+   p->expanded = (stbi_uc *) stbi__malloc_mad2(p->x, 8, 0); // out_n, then req_comp components
+   zout = (char *) stbi__malloc(STBI__ZWINDOW + STBI__ZSTREAM);
+   if (rows == NULL || p->expanded == NULL || zout == NULL) {
+      STBI_FREE(rows); STBI_FREE(p->expanded); STBI_FREE(zout);
+      return stbi__err("outofmem", "Out of memory");
+   }
+   p->cur = rows;
+   p->prior = rows + p->raw_len;
+   p->out = p->expanded + p->x*4;
+   memset(p->prior, 0, p->raw_len);
+
+   a.zbuffer = a.zbuffer_end = NULL;
+   p->z = &a;
+   p->total_in = p->total_out = 0;
+   if (stbi__do_zlib_stream(&a, zout, 1, stbi__png_rows_refill, p->raw ? stbi__png_raw_sink : stbi__png_rows_sink,
+                            p->raw && p->raw->block ? stbi__png_raw_block : NULL, p)) {
+      if (p->raw) p->stopped = 1; // all the data was decoded
+      else if (!p->stopped) stbi__err("not enough pixels","Corrupt PNG");
+   }
+
+   STBI_FREE(rows);
+   STBI_FREE(p->expanded);
+   STBI_FREE(zout);
+   return p->stopped;
+}
+
+STBIDEF int stbi_png_load_rows(char const *filename, int *x, int *y, int *comp, int req_comp, stbi_png_row_callback *callback, void *user)
+{
+   stbi__context s;
+   stbi__png_rows *p;
+   int result;
+   FILE *f = stbi__fopen(filename, "rb");
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   p = (stbi__png_rows *) stbi__malloc(sizeof(*p));
+   if (p == NULL) { fclose(f); return stbi__err("outofmem", "Out of memory"); }
+   stbi__start_file(&s, f);
+   p->s = &s;
+   p->callback = callback;
+   p->raw = NULL;
+   p->user = user;
+   result = stbi__png_load_rows_main(p, x, y, comp, req_comp);
+   STBI_FREE(p);
+   fclose(f);
+   return result;
+}
+
+STBIDEF int stbi_png_load_raw(char const *filename, int *x, int *y, int *comp, stbi_png_raw_callbacks const *callbacks, void *user)
+{
+   stbi__context s;
+   stbi__png_rows *p;
+   int result;
+   FILE *f = stbi__fopen(filename, "rb");
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   p = (stbi__png_rows *) stbi__malloc(sizeof(*p));
+   if (p == NULL) { fclose(f); return stbi__err("outofmem", "Out of memory"); }
+   stbi__start_file(&s, f);
+   p->s = &s;
+   p->callback = NULL;
+   p->raw = callbacks;
+   p->user = user;
+   result = stbi__png_load_rows_main(p, x, y, comp, 0);
+   STBI_FREE(p);
+   fclose(f);
+   return result;
+}
+#endif
+
 // Microsoft/Windows BMP image
 
 #ifndef STBI_NO_BMP
@@ -31,6 +31,9 @@ BUILDING:
    unsigned char * my_compress(unsigned char *data, int data_len, int *out_len, int quality);
    The returned data will be freed with STBIW_FREE() (free() by default),
    so it must be heap allocated with STBIW_MALLOC() (malloc() by default),
+   If it keeps tables between calls (see stbi_write_reuse_zlib_tables), #define
+   STBIW_ZLIB_FREE_TABLES to the function that frees them: it is called by
+   stbi_zlib_free_tables().
 
 UNICODE:
 
@@ -68,6 +71,8 @@ USAGE:
       int stbi_write_tga_with_rle;             // defaults to true; set to 0 to disable RLE
       int stbi_write_png_compression_level;    // defaults to 8; set to higher for more compression
       int stbi_write_force_png_filter;         // defaults to -1; set to 0..5 to force a filter mode
+      int stbi_write_reuse_zlib_tables;        // defaults to 0; set to 1 to keep each thread's deflate
+                                               // hash tables between calls (free them with stbi_zlib_free_tables)
 
 
    You can define STBI_WRITE_NO_STDIO to disable the file variant of these
@@ -170,6 +175,7 @@ LICENSE
 STBIWDEF int stbi_write_tga_with_rle;
 STBIWDEF int stbi_write_png_compression_level;
 STBIWDEF int stbi_write_force_png_filter;
+STBIWDEF int stbi_write_reuse_zlib_tables;
 #endif
 
 #ifndef STBI_WRITE_NO_STDIO
@@ -194,6 +200,9 @@ STBIWDEF int stbi_write_jpg_to_func(stbi_write_func *func, void *context, int x,
 
 STBIWDEF void stbi_flip_vertically_on_write(int flip_boolean);
 
+// frees the hash tables kept for the calling thread when stbi_write_reuse_zlib_tables is set
+STBIWDEF void stbi_zlib_free_tables(void);
+
 #endif//INCLUDE_STB_IMAGE_WRITE_H
 
 #ifdef STB_IMAGE_WRITE_IMPLEMENTATION
@@ -251,10 +260,24 @@ STBIWDEF void stbi_flip_vertically_on_write(int flip_boolean);
 static int stbi_write_png_compression_level = 8;
 static int stbi_write_tga_with_rle = 1;
 static int stbi_write_force_png_filter = -1;
+static int stbi_write_reuse_zlib_tables = 0;
 #else
 int stbi_write_png_compression_level = 8;
 int stbi_write_tga_with_rle = 1;
 int stbi_write_force_png_filter = -1;
+int stbi_write_reuse_zlib_tables = 0;
+#endif
+
+#ifndef STBIW_THREAD_LOCAL
+   #if defined(__cplusplus) &&  __cplusplus >= 201103L
+      #define STBIW_THREAD_LOCAL       thread_local
+   #elif defined(__GNUC__)
+      #define STBIW_THREAD_LOCAL       __thread
+   #elif defined(_MSC_VER)
+      #define STBIW_THREAD_LOCAL       __declspec(thread)
+   #elif defined (__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+      #define STBIW_THREAD_LOCAL       _Thread_local
+   #endif
 #endif
 
 static int stbi__flip_vertically_on_write = 0;
@@ -890,8 +913,28 @@ static unsigned int stbiw__zhash(unsigned char *data)
 
 #define stbiw__ZHASH   16384
 
+#ifdef STBIW_THREAD_LOCAL
+// hash tables kept between calls when stbi_write_reuse_zlib_tables is set
+static STBIW_THREAD_LOCAL unsigned char ***stbiw__zhash_cache;
+#endif
+
 #endif // STBIW_ZLIB_COMPRESS
 
+STBIWDEF void stbi_zlib_free_tables(void)
+{
+#if defined(STBIW_ZLIB_FREE_TABLES)
+   // the custom compress function keeps its own tables
+   STBIW_ZLIB_FREE_TABLES();
+#elif !defined(STBIW_ZLIB_COMPRESS) && defined(STBIW_THREAD_LOCAL)
+   int i;
+   if (stbiw__zhash_cache == NULL) return;
+   for (i=0; i < stbiw__ZHASH; ++i)
+      (void) stbiw__sbfree(stbiw__zhash_cache[i]);
+   STBIW_FREE(stbiw__zhash_cache);
+   stbiw__zhash_cache = NULL;
+#endif
+}
+
 STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality)
 {
 #ifdef STBIW_ZLIB_COMPRESS
@@ -905,9 +948,22 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
    unsigned int bitbuf=0;
    int i,j, bitcount=0;
    unsigned char *out = NULL;
-   unsigned char ***hash_table = (unsigned char***) STBIW_MALLOC(stbiw__ZHASH * sizeof(unsigned char**));
-   if (hash_table == NULL)
-      return NULL;
+   unsigned char ***hash_table = NULL;
+#ifdef STBIW_THREAD_LOCAL
+   if (stbi_write_reuse_zlib_tables && stbiw__zhash_cache) {
+      // reuse the previous call's buckets; only their counts need resetting
+      hash_table = stbiw__zhash_cache;
+      for (i=0; i < stbiw__ZHASH; ++i)
+         if (hash_table[i]) stbiw__sbn(hash_table[i]) = 0;
+   }
+#endif
+   if (hash_table == NULL) {
+      hash_table = (unsigned char***) STBIW_MALLOC(stbiw__ZHASH * sizeof(unsigned char**));
+      if (hash_table == NULL)
+         return NULL;
+      for (i=0; i < stbiw__ZHASH; ++i)
+         hash_table[i] = NULL;
+   }
    if (quality < 5) quality = 5;
 
    stbiw__sbpush(out, 0x78);   // DEFLATE 32K window
@@ -915,9 +971,6 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
    stbiw__zlib_add(1,1);  // BFINAL = 1
    stbiw__zlib_add(1,2);  // BTYPE = 1 -- fixed huffman
 
-   for (i=0; i < stbiw__ZHASH; ++i)
-      hash_table[i] = NULL;
-
    i=0;
    while (i < data_len-3) {
       // hash next 3 bytes of data to be compressed
@@ -977,9 +1030,16 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
    while (bitcount)
       stbiw__zlib_add(0,1);
 
-   for (i=0; i < stbiw__ZHASH; ++i)
-      (void) stbiw__sbfree(hash_table[i]);
-   STBIW_FREE(hash_table);
+#ifdef STBIW_THREAD_LOCAL
+   if (stbi_write_reuse_zlib_tables) {
+      stbiw__zhash_cache = hash_table;
+   } else
+#endif
+   {
+      for (i=0; i < stbiw__ZHASH; ++i)
+         (void) stbiw__sbfree(hash_table[i]);
+      STBIW_FREE(hash_table);
+   }
 
    // store uncompressed instead if compression was worse
    if (stbiw__sbn(out) > data_len + 2 + ((data_len+32766)/32767)*5) {
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stb_image.h"
+
+#include "pngcheck.h"
+#include "deflate.h"
+
+typedef unsigned char uchar;
+
+#define CHECK_LENGTH 1000 // la plus longue ligne vérifiée, en bytes
+
+// Un flux zlib fait d'un seul morceau (voir deflateChunk), alloué avec malloc (NULL si la mémoire manque)
+static uchar* compressZlib(DeflateTables* tables, const uchar* data, int length, int level, int* outLength) {
+    uchar* out = malloc(2 + deflateChunkBound(length) + 4);
+    if (out == NULL) return NULL;
+    unsigned adler;
+    uchar* end = out + deflateHeader(level, out);
+    end += deflateChunk(tables, data, 0, length, level, 1, end, &adler);
+    for (int i = 0; i < 4; i++) *end++ = adler >> (24 - 8 * i);
+    *outLength = end - out;
+    return out;
+}
+
+// Le défiltrage SIMD des lignes contre les boucles scalaires, pour chaque filtre et nombre de composants
+static int checkDefiltering(void) {
+    uchar prior[CHECK_LENGTH];
+    uchar expected[CHECK_LENGTH];
+    uchar result[CHECK_LENGTH];
+    unsigned int seed = 12345;
+    int errors = 0;
+
+    for (int channels = 1; channels <= 4; channels++) {
+        for (int filter = 0; filter <= 4; filter++) {
+            for (long length = channels; length <= CHECK_LENGTH; length += channels * (1 + length / 16)) {
+                for (long j = 0; j < CHECK_LENGTH; j++) {
+                    prior[j] = (seed = seed * 1103515245 + 12345) >> 16;
+                    expected[j] = result[j] = (seed = seed * 1103515245 + 12345) >> 16;
+                }
+                stbi_png_defilter_row(expected, prior, filter, channels, length, 0);
+                stbi_png_defilter_row(result, prior, filter, channels, length, 1);
+                if (memcmp(result, expected, CHECK_LENGTH) != 0) {
+                    fprintf(stderr, "Png defiltering mismatch (filter %d, %d channels, %ld bytes)\n", filter, channels, length);
+                    errors++;
+                }
+            }
+        }
+    }
+    return errors;
+}
+
+// Décompression rapide contre symbole par symbole, sur des données plus ou moins aléatoires avec des répétitions proches
+static int checkInflate(void) {
+    unsigned int seed = 12345;
+    int errors = 0;
+    const int inflateLength = 200000;
+    uchar* data = malloc(inflateLength);
+    DeflateTables* tables = deflateNewTables();
+    int compressedLength;
+    for (int level = 0; data != NULL && tables != NULL && level <= 9; level += 3) {
+        for (int bits = 1; bits <= 8; bits *= 2) {
+            for (int j = 0; j < inflateLength; j++) {
+                seed = seed * 1103515245 + 12345;
+                data[j] = j % 3000 < 1500 ? (seed >> 16) & ((1 << bits) - 1) : data[j - 1 - j % 7];
+            }
+            int slowLength, fastLength;
+            uchar* compressed = compressZlib(tables, data, inflateLength, level, &compressedLength);
+            if (compressed == NULL) continue;
+            stbi_zlib_set_fast_inflate(0);
+            char* slow = stbi_zlib_decode_malloc((char*) compressed, compressedLength, &slowLength);
+            stbi_zlib_set_fast_inflate(1);
+            char* fast = stbi_zlib_decode_malloc((char*) compressed, compressedLength, &fastLength);
+            if (slow == NULL || fast == NULL || slowLength != inflateLength || fastLength != inflateLength
+                || memcmp(slow, data, inflateLength) != 0 || memcmp(fast, data, inflateLength) != 0) {
+                fprintf(stderr, "Inflate mismatch (level %d, %d random bits per byte)\n", level, bits);
+                errors++;
+            }
+            free(slow);
+            free(fast);
+            free(compressed);
+        }
+    }
+    free(data);
+    deflateDeleteTables(tables);
+
+    return errors;
+}
+
+int checkPngDecoding(void) {
+    return checkDefiltering() + checkInflate();
+}
@@ -0,0 +1,11 @@
+#ifndef PNGCHECK_H
+#define PNGCHECK_H
+
+/*\
+ * Vérifie les versions optimisées du décodage des png (stb_image) contre ses boucles d'origine:
+ * le défiltrage SIMD des lignes contre les boucles scalaires, et la décompression rapide contre celle
+ * symbole par symbole (sur des flux écrits par deflate.c). Renvoie le nombre de différences trouvées.
+\*/
+int checkPngDecoding(void);
+
+#endif
@@ -0,0 +1,281 @@
+#define _GNU_SOURCE // copy_file_range
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stb_image.h"
+
+#include "pngsplice.h"
+#include "deflate.h"
+#include "adler32.h"
+#include "crc32.h"
+
+typedef unsigned char uchar;
+
+#define WINDOW_SIZE 32768 // la distance au plus d'une correspondance deflate
+
+typedef struct {
+    long start;  // la position de ses données dans le fichier
+    long length;
+    long offset; // la position de ses données dans le flux zlib (les chunks IDAT mis bout à bout)
+} Idat;
+
+// Le png d'origine, projeté en mémoire
+typedef struct {
+    const uchar* bytes;
+    long length;
+    int fd;
+    int width, height;
+    Idat* idats;
+    int idatCount;
+} Source;
+
+// Le début des données décodées, jusqu'au bloc où le flux d'origine est repris
+typedef struct {
+    uchar* raw;
+    long length, capacity;
+    long threshold;      // le bloc doit commencer après autant de bytes décodés
+    long resumeOffset;   // les bytes décodés avant le bloc (-1: pas encore trouvé)
+    long long resumeBit; // la position du bloc dans le flux zlib, en bits
+} Prefix;
+
+static unsigned getUint32(const uchar* in) {
+    return (unsigned) in[0] << 24 | in[1] << 16 | in[2] << 8 | in[3];
+}
+
+static void putUint32(uchar* out, unsigned value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+// Le CRC d'un chunk IDAT dont les données sont data
+static unsigned idatCrc(const uchar* data, long length) {
+    return crc32Update(crc32Update(0, (const uchar*) "IDAT", 4), data, length);
+}
+
+/*\
+ * Projette le png en mémoire et relève ses chunks IDAT. Renvoie 0 si c'est un png RGB 8 bits non entrelacé
+ * avec des chunks IDAT qui se suivent, et dont le dernier contient tout l'Adler-32.
+\*/
+static int openSource(const char* path, Source* source) {
+    memset(source, 0, sizeof(Source));
+    source->fd = open(path, O_RDONLY);
+    if (source->fd < 0) return 1;
+    struct stat info;
+    if (fstat(source->fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size < 8 + 25) return 1;
+    void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, source->fd, 0);
+    if (mapping == MAP_FAILED) return 1;
+    source->bytes = mapping;
+    source->length = info.st_size;
+
+    static const uchar signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    const uchar* ihdr = source->bytes + 8;
+    if (memcmp(source->bytes, signature, 8) != 0 || getUint32(ihdr) != 13 || memcmp(ihdr + 4, "IHDR", 4) != 0) return 1;
+    source->width = getUint32(ihdr + 8);
+    source->height = getUint32(ihdr + 12);
+    // 8 bits, RGB, deflate, filtres adaptatifs, pas d'entrelacement
+    if (source->width <= 0 || source->height <= 0 || memcmp(ihdr + 16, "\x08\x02\x00\x00\x00", 5) != 0) return 1;
+
+    int capacity = 0, ended = 0;
+    long position = 8, offset = 0;
+    while (position + 12 <= source->length) {
+        const long length = getUint32(source->bytes + position);
+        const uchar* type = source->bytes + position + 4;
+        if (length > source->length - position - 12) return 1;
+        if (memcmp(type, "IDAT", 4) == 0) {
+            if (ended) return 1;
+            if (source->idatCount == capacity) {
+                capacity = capacity == 0 ? 64 : capacity * 2;
+                Idat* idats = realloc(source->idats, capacity * sizeof(Idat));
+                if (idats == NULL) return 1;
+                source->idats = idats;
+            }
+            source->idats[source->idatCount++] = (Idat) { position + 8, length, offset };
+            offset += length;
+        } else if (source->idatCount > 0) {
+            ended = 1;
+        }
+        if (memcmp(type, "IEND", 4) == 0) break;
+        position += 12 + length;
+    }
+    return source->idatCount == 0 || source->idats[source->idatCount - 1].length < 4;
+}
+
+static void closeSource(Source* source) {
+    if (source->bytes != NULL) munmap((void*) source->bytes, source->length);
+    if (source->fd >= 0) close(source->fd);
+    free(source->idats);
+}
+
+static int addRaw(void* user, const uchar* data, int length) {
+    Prefix* prefix = user;
+    if (prefix->length + length > prefix->capacity) {
+        long capacity = prefix->capacity == 0 ? 1 << 20 : prefix->capacity;
+        while (capacity < prefix->length + length) capacity *= 2;
+        uchar* raw = realloc(prefix->raw, capacity);
+        if (raw == NULL) return 0;
+        prefix->raw = raw;
+        prefix->capacity = capacity;
+    }
+    memcpy(prefix->raw + prefix->length, data, length);
+    prefix->length += length;
+    return 1;
+}
+
+// On s'arrête au premier bloc assez loin des lignes modifiées
+static int checkBlock(void* user, long long rawOffset, long long bitOffset) {
+    Prefix* prefix = user;
+    if (rawOffset < prefix->threshold) return 1;
+    prefix->resumeOffset = rawOffset;
+    prefix->resumeBit = bitOffset;
+    return 0;
+}
+
+// Copie les bytes [start, start + length[ du png d'origine dans output, par le noyau si possible
+static int copyRange(const Source* source, FILE* output, long start, long length) {
+    if (fflush(output) != 0) return 1;
+    loff_t offset = start;
+    while (length > 0) {
+        const ssize_t count = copy_file_range(source->fd, &offset, fileno(output), NULL, length, 0);
+        if (count <= 0) break;
+        length -= count;
+    }
+    // Pas de copy_file_range entre ces fichiers (systèmes de fichiers différents, pipe...): copie classique
+    return length > 0 && fwrite(source->bytes + offset, 1, length, output) != (size_t) length;
+}
+
+// Écrit un chunk IDAT fait de head, puis de body dont les 4 derniers bytes sont remplacés par trailer s'il n'est pas NULL
+static int writeIdat(FILE* output, const uchar* head, long headLength, const uchar* body, long bodyLength,
+                     const uchar* trailer, unsigned crc) {
+    uchar header[8], footer[4];
+    putUint32(header, headLength + bodyLength);
+    memcpy(header + 4, "IDAT", 4);
+    putUint32(footer, crc);
+    const long kept = trailer != NULL ? bodyLength - 4 : bodyLength;
+    int failed = fwrite(header, 1, 8, output) != 8;
+    failed |= headLength > 0 && fwrite(head, 1, headLength, output) != (size_t) headLength;
+    failed |= kept > 0 && fwrite(body, 1, kept, output) != (size_t) kept;
+    failed |= trailer != NULL && fwrite(trailer, 1, 4, output) != 4;
+    failed |= fwrite(footer, 1, 4, output) != 4;
+    return failed;
+}
+
+/*\
+ * Écrit la suite du flux d'origine à partir du bit resumeBit, après les headLength bytes de blocs vides de head.
+ * Si le bloc d'origine ne commence pas sur un byte entier, son premier byte est complété par les derniers bits
+ * des blocs vides (partial) et ajouté à head. Le dernier chunk reçoit le nouvel Adler-32.
+ *
+ * Les CRC se corrigent sans relire les données recopiées: le CRC de A suivi de B est celui de A décalé de la taille de B
+ * (crc32Combine(crcA, 0, lengthB)), combiné par xor avec celui de B.
+\*/
+static int writeTail(const Source* source, FILE* output, long long resumeBit, uchar* head, int headLength, uchar partial,
+                     unsigned adler) {
+    const long resume = resumeBit >> 3;
+    const int bit = resumeBit & 7;
+    const Idat* last = &source->idats[source->idatCount - 1];
+    const uchar* oldTrailer = source->bytes + last->start + last->length - 4;
+    uchar trailer[4];
+    putUint32(trailer, adler);
+    const unsigned trailerCrc = crc32Update(0, oldTrailer, 4) ^ crc32Update(0, trailer, 4);
+
+    int i = 0;
+    while (source->idats[i].offset + source->idats[i].length <= resume) i++;
+    const Idat* first = &source->idats[i];
+    const uchar* data = source->bytes + first->start;
+    // Les bit premiers bits du byte où commence le bloc sont la fin du bloc précédent
+    if (bit != 0) head[headLength++] = (partial & ((1 << bit) - 1)) | (data[resume - first->offset] & (0xff << bit));
+    const long replaced = resume - first->offset + (bit != 0); // A: les bytes d'origine remplacés par head
+    const long kept = first->length - replaced;                // B: la suite du chunk
+
+    unsigned crc = getUint32(data + first->length);
+    crc ^= crc32Combine(idatCrc(head, headLength) ^ idatCrc(data, replaced), 0, kept);
+    if (first == last) crc ^= trailerCrc;
+    int failed = writeIdat(output, head, headLength, data + replaced, kept, first == last ? trailer : NULL, crc);
+    if (first == last) return failed;
+
+    // Les chunks entre les deux sont recopiés en entier, avec leur en-tête et leur CRC
+    const long start = first->start + first->length + 4;
+    failed |= copyRange(source, output, start, last->start - 8 - start);
+    crc = getUint32(source->bytes + last->start + last->length) ^ trailerCrc;
+    failed |= writeIdat(output, NULL, 0, source->bytes + last->start, last->length, trailer, crc);
+    return failed;
+}
+
+int pngSplice(const char* imgPath, int dirtyRows, PngWriter* writer, FILE* output, SpliceRowCallback addRow, void* user) {
+    Source source;
+    Prefix prefix = { .resumeOffset = -1 };
+    uchar* rows = NULL;
+    int result = 1;
+
+    if (openSource(imgPath, &source) != 0 || dirtyRows + 1 >= source.height) goto end;
+    const long rowLength = (long) source.width * 3;
+    const long dataLength = (long) source.height * (rowLength + 1); // avec l'octet de filtre de chaque ligne
+    const long dirtyLength = (long) (dirtyRows + 1) * (rowLength + 1);
+    prefix.threshold = dirtyLength + WINDOW_SIZE;
+
+    // Décodage jusqu'au premier bloc assez loin des lignes modifiées, sans défiltrer
+    const stbi_png_raw_callbacks callbacks = { addRaw, checkBlock };
+    int width, height, channels;
+    if (!stbi_png_load_raw(imgPath, &width, &height, &channels, &callbacks, &prefix) || prefix.resumeOffset < 0
+        || prefix.resumeOffset != prefix.length || prefix.length >= dataLength
+        || width != source.width || height != source.height || channels != 3) {
+        goto end;
+    }
+    for (int y = 0; y <= dirtyRows; y++) {
+        if (prefix.raw[y * (rowLength + 1)] > 4) goto end;
+    }
+
+    // Les lignes modifiées (et la suivante) sont défiltrées et passées à addRow, le reste est ajouté tel quel
+    rows = calloc(3, rowLength); // la ligne précédente, la ligne défiltrée, et celle passée à addRow
+    if (rows == NULL) goto end;
+    result = -1;
+    uchar* prior = rows;
+    uchar* current = rows + rowLength;
+    for (int y = 0; y <= dirtyRows; y++) {
+        const uchar* raw = prefix.raw + y * (rowLength + 1);
+        memcpy(current, raw + 1, rowLength);
+        stbi_png_defilter_row(current, prior, raw[0], 3, rowLength, 1);
+        memcpy(rows + 2 * rowLength, current, rowLength);
+        if (!addRow(user, rows + 2 * rowLength, y)) {
+            pngWriterClose(writer);
+            goto end;
+        }
+        uchar* swap = prior;
+        prior = current;
+        current = swap;
+    }
+    unsigned adler;
+    long length;
+    if (pngWriterAddFiltered(writer, prefix.raw + dirtyLength, prefix.length - dirtyLength) != 0) {
+        pngWriterClose(writer);
+        goto end;
+    }
+    if (pngWriterDetach(writer, &adler, &length) != 0) goto end;
+
+    // L'Adler-32 de tout le flux: celui des données écrites, puis celui de la suite des données d'origine
+    const Idat* last = &source.idats[source.idatCount - 1];
+    const unsigned sourceAdler = getUint32(source.bytes + last->start + last->length - 4);
+    const long restLength = dataLength - prefix.length;
+    const unsigned restAdler = adler32Suffix(sourceAdler, adler32Update(1, prefix.raw, prefix.length), restLength);
+    adler = adler32Combine(adler, restAdler, restLength);
+
+    // Des blocs vides jusqu'au bit où commence le bloc d'origine
+    uchar head[17], partial;
+    const int headLength = deflateEmptyBlocks(prefix.resumeBit & 7, head, &partial);
+    if (writeTail(&source, output, prefix.resumeBit, head, headLength, partial, adler) != 0) goto end;
+
+    static const uchar iend[12] = { 0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xae, 0x42, 0x60, 0x82 };
+    if (fwrite(iend, 1, 12, output) != 12) goto end;
+    result = 0;
+
+end:
+    free(rows);
+    free(prefix.raw);
+    closeSource(&source);
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef PNGSPLICE_H
+#define PNGSPLICE_H
+
+/*\
+ * Réencodage incrémental d'un png dont seules les premières lignes changent.
+ * Le flux zlib d'origine est repris tel quel à partir du premier bloc deflate qui commence au moins 32 Ko
+ * (la fenêtre de deflate) après les lignes modifiées: ses correspondances ne peuvent plus remonter jusqu'à elles.
+ * Seules les lignes avant ce bloc sont décodées et recompressées par le PngWriter, qui s'arrête sans terminer
+ * le flux zlib. Des blocs vides l'amènent au même bit que le bloc d'origine dans son byte, et la suite des
+ * chunks IDAT est recopiée sans être décodée (avec copy_file_range quand c'est possible). Les CRC des chunks
+ * et l'Adler-32 du flux sont corrigés à partir de ceux d'origine, sans relire les données recopiées.
+ *
+ * Le png doit être un png RGB 8 bits non entrelacé (comme ceux qu'écrit PngWriter avec 3 composants).
+\*/
+
+#include <stdio.h>
+
+#include "pngwrite.h"
+
+// Reçoit la ligne y de l'image d'origine (en RGB), la modifie et l'ajoute au PngWriter; renvoie 0 en cas d'erreur
+typedef int (*SpliceRowCallback)(void* user, unsigned char* row, int y);
+
+/*\
+ * Écrit le png imgPath dans writer (ouvert sur output pour une image de la même taille, sans ligne ajoutée):
+ * les lignes [0, dirtyRows] sont passées à addRow (la ligne dirtyRows ne change pas, mais son filtre dépend
+ * de la précédente), puis la fin du png d'origine est reprise.
+ * Renvoie 0 si le png a été écrit; 1 si le png ne s'y prête pas (pas un png RGB 8 bits, trop petit, pas de bloc
+ * assez loin...) et rien n'a été ajouté à writer: il faut alors réencoder toute l'image; -1 en cas d'erreur.
+ * writer est libéré, sauf quand 1 est renvoyé.
+\*/
+int pngSplice(const char* imgPath, int dirtyRows, PngWriter* writer, FILE* output, SpliceRowCallback addRow, void* user);
+
+#endif
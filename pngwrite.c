@@ -0,0 +1,465 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "pngwrite.h"
+#include "deflate.h"
+#include "adler32.h"
+#include "crc32.h"
+
+typedef unsigned char uchar;
+
+#define BAND_SIZE (256 * 1024) // la taille visée des lignes filtrées d'une bande
+#define WINDOW_SIZE 32768      // le dictionnaire gardé d'une bande à la suivante
+
+typedef struct {
+    PngWriter* writer;
+    uchar* data;          // WINDOW_SIZE bytes pour le dictionnaire, puis les lignes filtrées de la bande
+    int dictionaryLength; // les bytes utilisés juste avant les lignes
+    int length;
+    int final;
+    DeflateTables* tables; // empruntées au PngTables de pngWriterOpen (NULL sans compression)
+
+    uchar* out;           // la bande compressée
+    int outLength;
+    unsigned adler;       // l'Adler-32 des lignes filtrées
+    unsigned crc;         // le CRC-32 de la bande compressée, calculé en même temps qu'elle
+} Band;
+
+struct PngWriter {
+    FILE* file;
+    int width, height, channels;
+    int level;
+    PngFilters filters;
+    ThreadPool* pool;
+
+    int rowLength;       // width * channels
+    int rowCount;        // les lignes déjà ajoutées
+    uchar* prior;        // la ligne précédente avant filtrage (des 0 avant la première ligne)
+    uchar* candidates[2];
+
+    Band* bands;         // bands[0..current[ sont compressées sur le pool et attendent d'être écrites
+    int bandCount;
+    int current;         // la bande qui reçoit les lignes
+    int bandCapacity;
+    int headerWritten;   // l'en-tête zlib est écrit avec la première bande
+    int detached;        // pngWriterDetach: la dernière bande ne termine pas le flux zlib
+    unsigned adler;      // l'Adler-32 des bandes déjà écrites
+    long length;         // la taille des données des bandes déjà écrites
+    int failed;
+};
+
+// === Chunks ===
+
+static void putUint32(uchar* out, unsigned value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static void writeBytes(PngWriter* writer, const uchar* data, long length, unsigned* crc) {
+    if (crc != NULL) *crc = crc32Update(*crc, data, length);
+    if (length > 0 && fwrite(data, 1, length, writer->file) != (size_t) length) writer->failed = 1;
+}
+
+// Écrit la taille et le type d'un chunk; renvoie le début de son CRC (qui couvre le type et les données)
+static unsigned beginChunk(PngWriter* writer, const char* type, unsigned length) {
+    uchar header[4];
+    putUint32(header, length);
+    writeBytes(writer, header, 4, NULL);
+    unsigned crc = 0;
+    writeBytes(writer, (const uchar*) type, 4, &crc);
+    return crc;
+}
+
+static void endChunk(PngWriter* writer, unsigned crc) {
+    uchar footer[4];
+    putUint32(footer, crc);
+    writeBytes(writer, footer, 4, NULL);
+}
+
+// === Filtres ===
+
+static inline uchar paeth(int a, int b, int c) {
+    const int p = a + b - c;
+    const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+// La prédiction du filtre type pour le byte x, à partir des bytes à gauche (a), au-dessus (b) et en haut à gauche (c)
+static inline uchar predict(int type, int a, int b, int c) {
+    switch (type) {
+        case 1: return a;
+        case 2: return b;
+        case 3: return (a + b) >> 1;
+        case 4: return paeth(a, b, c);
+        default: return 0;
+    }
+}
+
+#ifdef __SSE2__
+/*\
+ * Les filtres de l'encodeur ne dépendent que de la ligne d'origine et de la précédente: ils sont calculés
+ * 16 bytes à la fois, avec la somme de leurs valeurs absolues (psadbw). Paeth est calculé sur des mots de 16 bits.
+\*/
+static inline __m128i absEpi16(__m128i x) {
+    return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static inline __m128i select128(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128i paethEpi16(__m128i a, __m128i b, __m128i c) {
+    // p = a + b - c, donc |p - a| = |b - c|, |p - b| = |a - c| et |p - c| = |(b - c) + (a - c)|
+    __m128i pa = _mm_sub_epi16(b, c);
+    __m128i pb = _mm_sub_epi16(a, c);
+    const __m128i pc = absEpi16(_mm_add_epi16(pa, pb));
+    pa = absEpi16(pa);
+    pb = absEpi16(pb);
+    const __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+    return select128(_mm_cmpeq_epi16(smallest, pa), a, select128(_mm_cmpeq_epi16(smallest, pb), b, c));
+}
+
+static inline __attribute__((always_inline)) __m128i predictSse2(int type, __m128i a, __m128i b, __m128i c) {
+    const __m128i zero = _mm_setzero_si128();
+    switch (type) {
+        case 1: return a;
+        case 2: return b;
+        case 3: return _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+        case 4:
+            return _mm_packus_epi16(
+                paethEpi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero)),
+                paethEpi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero)));
+        default: return zero;
+    }
+}
+
+// Filtre les bytes [i, length[ par blocs de 16 (i >= bpp) et ajoute leur somme à cost; renvoie où il s'est arrêté
+static inline __attribute__((always_inline)) int filterSse2(uchar* out, const uchar* row, const uchar* prior, int i,
+                                                            int length, int bpp, int type, long* cost) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sums = zero;
+    for (; i + 16 <= length; i += 16) {
+        const __m128i x = _mm_loadu_si128((const __m128i*) (row + i));
+        const __m128i a = _mm_loadu_si128((const __m128i*) (row + i - bpp));
+        const __m128i b = _mm_loadu_si128((const __m128i*) (prior + i));
+        const __m128i c = _mm_loadu_si128((const __m128i*) (prior + i - bpp));
+        const __m128i filtered = _mm_sub_epi8(x, predictSse2(type, a, b, c));
+        _mm_storeu_si128((__m128i*) (out + i), filtered);
+        // |byte signé| = min(byte, -byte) lus comme non signés
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_min_epu8(filtered, _mm_sub_epi8(zero, filtered)), zero));
+    }
+    *cost += _mm_cvtsi128_si64(sums) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums));
+    return i;
+}
+#endif
+
+/*\
+ * Filtre la ligne avec le filtre type: out[0] reçoit le type, puis length bytes filtrés.
+ * Renvoie la somme des différences (les bytes filtrés lus comme signés, en valeur absolue):
+ * la plus petite se compresse en général le mieux.
+\*/
+static inline __attribute__((always_inline)) long filterRowType(uchar* out, const uchar* row, const uchar* prior,
+                                                                int length, int bpp, int type) {
+    *out++ = type;
+    long cost = 0;
+    int i = 0;
+    // Les premiers bytes n'ont pas de pixel à gauche
+    for (; i < bpp; i++) {
+        out[i] = row[i] - predict(type, 0, prior[i], 0);
+        cost += abs((signed char) out[i]);
+    }
+#ifdef __SSE2__
+    i = filterSse2(out, row, prior, i, length, bpp, type, &cost);
+#endif
+    for (; i < length; i++) {
+        out[i] = row[i] - predict(type, row[i - bpp], prior[i], prior[i - bpp]);
+        cost += abs((signed char) out[i]);
+    }
+    return cost;
+}
+
+static long filterRow(uchar* out, const uchar* row, const uchar* prior, int length, int bpp, int type) {
+    switch (type) {
+        case 1: return filterRowType(out, row, prior, length, bpp, 1);
+        case 2: return filterRowType(out, row, prior, length, bpp, 2);
+        case 3: return filterRowType(out, row, prior, length, bpp, 3);
+        case 4: return filterRowType(out, row, prior, length, bpp, 4);
+        default: return filterRowType(out, row, prior, length, bpp, 0);
+    }
+}
+
+// Les filtres essayés pour chaque mode de PngFilters, dans l'ordre (le premier gagne en cas d'égalité)
+static const struct {
+    int count;
+    uchar types[5];
+} filterSets[] = {
+    [PNG_FILTERS_ALL] = { 5, { 0, 1, 2, 3, 4 } },
+    [PNG_FILTERS_UP_SUB] = { 2, { 1, 2 } },
+    [PNG_FILTERS_PAETH] = { 1, { 4 } },
+    [PNG_FILTERS_NONE] = { 1, { 0 } },
+};
+
+// === Bandes ===
+
+/*\
+ * Sans compression, les lignes filtrées sont écrites directement depuis la bande dans des blocs sans compression:
+ * seuls leurs en-têtes sont dans out. Le CRC couvre les en-têtes et les lignes, dans l'ordre où ils seront écrits.
+\*/
+static void storeBand(Band* band) {
+    const uchar* data = band->data + WINDOW_SIZE;
+    int offset = 0, blockCount = 0;
+    unsigned crc = 0;
+    do {
+        const int length = band->length - offset < DEFLATE_MAX_STORED ? band->length - offset : DEFLATE_MAX_STORED;
+        uchar* header = band->out + 5 * blockCount++;
+        deflateStoredHeader(length, band->final && offset + length == band->length, header);
+        crc = crc32Update(crc32Update(crc, header, 5), data + offset, length);
+        offset += length;
+    } while (offset < band->length);
+    band->outLength = band->length + 5 * blockCount;
+    band->adler = adler32Update(1, data, band->length);
+    band->crc = crc;
+}
+
+static void compressBand(void* arg) {
+    Band* band = arg;
+    if (band->writer->level == 0) {
+        storeBand(band);
+        return;
+    }
+    band->outLength = deflateChunk(band->tables, band->data + WINDOW_SIZE, band->dictionaryLength, band->length,
+                                   band->writer->level, band->final, band->out, &band->adler);
+    band->crc = crc32Update(0, band->out, band->outLength);
+}
+
+// Écrit une bande compressée dans un chunk IDAT, avec l'en-tête zlib avant la première et l'Adler-32 après la dernière
+static void writeBand(PngWriter* writer, Band* band) {
+    uchar header[2], trailer[4];
+    const int headerLength = writer->headerWritten ? 0 : deflateHeader(writer->level, header);
+    writer->headerWritten = 1;
+    writer->adler = adler32Combine(writer->adler, band->adler, band->length);
+    writer->length += band->length;
+    putUint32(trailer, writer->adler);
+    const int trailerLength = band->final ? 4 : 0;
+
+    unsigned crc = beginChunk(writer, "IDAT", headerLength + band->outLength + trailerLength);
+    writeBytes(writer, header, headerLength, &crc);
+    if (writer->level == 0) {
+        for (int offset = 0, i = 0; offset < band->length || i == 0; offset += DEFLATE_MAX_STORED, i++) {
+            const int length = band->length - offset < DEFLATE_MAX_STORED ? band->length - offset : DEFLATE_MAX_STORED;
+            writeBytes(writer, band->out + 5 * i, 5, NULL);
+            writeBytes(writer, band->data + WINDOW_SIZE + offset, length, NULL);
+        }
+    } else {
+        writeBytes(writer, band->out, band->outLength, NULL);
+    }
+    crc = crc32Combine(crc, band->crc, band->outLength);
+    writeBytes(writer, trailer, trailerLength, &crc);
+    endChunk(writer, crc);
+}
+
+// Compresse la bande en cours (sur le pool s'il y en a un) et passe à la suivante, en gardant la fin de ses données comme dictionnaire
+static void finishBand(PngWriter* writer, int final) {
+    Band* band = &writer->bands[writer->current];
+    band->final = final && !writer->detached;
+
+    if (writer->bandCount == 1) {
+        compressBand(band);
+        writeBand(writer, band);
+    } else {
+        submitTask(writer->pool, compressBand, band);
+        if (writer->current == writer->bandCount - 1 || final) {
+            // Toutes les bandes sont utilisées: on attend qu'elles soient compressées pour les écrire dans l'ordre
+            waitTasks(writer->pool);
+            for (int i = 0; i <= writer->current; i++) writeBand(writer, &writer->bands[i]);
+            writer->current = -1;
+        }
+    }
+    writer->current = (writer->current + 1) % writer->bandCount;
+
+    Band* next = &writer->bands[writer->current];
+    const int available = band->dictionaryLength + band->length;
+    const int dictionaryLength = available < WINDOW_SIZE ? available : WINDOW_SIZE;
+    memmove(next->data + WINDOW_SIZE - dictionaryLength, band->data + WINDOW_SIZE + band->length - dictionaryLength, dictionaryLength);
+    next->dictionaryLength = dictionaryLength;
+    next->length = 0;
+}
+
+// === Écriture ===
+
+void pngTablesFree(PngTables* tables) {
+    for (int i = 0; i < tables->count; i++) deflateDeleteTables(tables->tables[i]);
+    free(tables->tables);
+    tables->tables = NULL;
+    tables->count = 0;
+}
+
+// Ajoute des tables à tables pour en avoir au moins count. Renvoie 0 si tout s'est bien passé
+static int reserveTables(PngTables* tables, int count) {
+    if (tables->count >= count) return 0;
+    DeflateTables** grown = realloc(tables->tables, count * sizeof(DeflateTables*));
+    if (grown == NULL) return 1;
+    tables->tables = grown;
+    while (tables->count < count) {
+        grown[tables->count] = deflateNewTables();
+        if (grown[tables->count] == NULL) return 1;
+        tables->count++;
+    }
+    return 0;
+}
+
+PngWriter* pngWriterOpen(FILE* file, int width, int height, int channels, int level, ThreadPool* pool, PngTables* tables) {
+    if (width <= 0 || height <= 0 || channels < 1 || channels > 4) return NULL;
+
+    PngWriter* writer = calloc(1, sizeof(PngWriter));
+    if (writer == NULL) return NULL;
+    writer->file = file;
+    writer->width = width;
+    writer->height = height;
+    writer->channels = channels;
+    writer->level = level;
+    writer->pool = pool;
+    writer->rowLength = width * channels;
+    writer->adler = 1;
+
+    // Assez de bandes pour que le pool ait toujours de quoi compresser pendant que les suivantes se remplissent
+    writer->bandCount = threadPoolSize(pool) > 1 ? 2 * threadPoolSize(pool) : 1;
+    int rowsPerBand = BAND_SIZE / (writer->rowLength + 1);
+    if (rowsPerBand < 1) rowsPerBand = 1;
+    if (rowsPerBand > height) rowsPerBand = height;
+    writer->bandCapacity = rowsPerBand * (writer->rowLength + 1);
+
+    writer->prior = calloc(writer->rowLength, 1);
+    writer->candidates[0] = malloc(writer->rowLength + 1);
+    writer->candidates[1] = malloc(writer->rowLength + 1);
+    writer->bands = calloc(writer->bandCount, sizeof(Band));
+    int failed = writer->prior == NULL || writer->candidates[0] == NULL || writer->candidates[1] == NULL || writer->bands == NULL;
+    // Sans compression, les bandes n'ont pas besoin de tables
+    failed |= level > 0 && reserveTables(tables, writer->bandCount) != 0;
+    for (int i = 0; !failed && i < writer->bandCount; i++) {
+        Band* band = &writer->bands[i];
+        band->writer = writer;
+        band->data = malloc(WINDOW_SIZE + writer->bandCapacity);
+        band->out = malloc(deflateChunkBound(writer->bandCapacity));
+        band->tables = level > 0 ? tables->tables[i] : NULL;
+        failed = band->data == NULL || band->out == NULL;
+    }
+    if (failed) {
+        writer->failed = 1;
+        pngWriterClose(writer);
+        return NULL;
+    }
+
+    static const uchar signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    static const uchar colorTypes[5] = { 0, 0, 4, 2, 6 }; // gris, gris + alpha, RGB, RGBA
+    writeBytes(writer, signature, 8, NULL);
+
+    uchar header[13];
+    putUint32(header, width);
+    putUint32(header + 4, height);
+    header[8] = 8; // bits par composant
+    header[9] = colorTypes[channels];
+    header[10] = 0; // compression deflate
+    header[11] = 0; // filtres adaptatifs
+    header[12] = 0; // pas d'entrelacement
+    unsigned crc = beginChunk(writer, "IHDR", 13);
+    writeBytes(writer, header, 13, &crc);
+    endChunk(writer, crc);
+
+    return writer;
+}
+
+void pngWriterSetFilters(PngWriter* writer, PngFilters filters) {
+    writer->filters = filters;
+}
+
+int pngWriterAddRow(PngWriter* writer, const unsigned char* row) {
+    if (writer->rowCount == writer->height) return 1;
+
+    const int filteredLength = writer->rowLength + 1;
+    if (writer->bands[writer->current].length + filteredLength > writer->bandCapacity) finishBand(writer, 0);
+
+    Band* band = &writer->bands[writer->current];
+    uchar* filtered = band->data + WINDOW_SIZE + band->length;
+    const int count = filterSets[writer->filters].count;
+    const uchar* types = filterSets[writer->filters].types;
+    if (count == 1) {
+        filterRow(filtered, row, writer->prior, writer->rowLength, writer->channels, types[0]);
+    } else {
+        // On garde le filtre qui donne la plus petite somme, le premier en cas d'égalité
+        long bestCost = -1;
+        for (int i = 0; i < count; i++) {
+            const long cost = filterRow(writer->candidates[1], row, writer->prior, writer->rowLength, writer->channels, types[i]);
+            if (bestCost < 0 || cost < bestCost) {
+                bestCost = cost;
+                uchar* swap = writer->candidates[0];
+                writer->candidates[0] = writer->candidates[1];
+                writer->candidates[1] = swap;
+            }
+        }
+        memcpy(filtered, writer->candidates[0], filteredLength);
+    }
+    band->length += filteredLength;
+    memcpy(writer->prior, row, writer->rowLength);
+    writer->rowCount++;
+    return writer->failed;
+}
+
+int pngWriterAddFiltered(PngWriter* writer, const unsigned char* data, long length) {
+    while (length > 0) {
+        Band* band = &writer->bands[writer->current];
+        if (band->length == writer->bandCapacity) {
+            finishBand(writer, 0);
+            band = &writer->bands[writer->current];
+        }
+        const int count = length < writer->bandCapacity - band->length ? length : writer->bandCapacity - band->length;
+        memcpy(band->data + WINDOW_SIZE + band->length, data, count);
+        band->length += count;
+        data += count;
+        length -= count;
+    }
+    return writer->failed;
+}
+
+static int freeWriter(PngWriter* writer) {
+    const int failed = writer->failed;
+
+    for (int i = 0; writer->bands != NULL && i < writer->bandCount; i++) {
+        free(writer->bands[i].data);
+        free(writer->bands[i].out);
+    }
+    free(writer->bands);
+    free(writer->prior);
+    free(writer->candidates[0]);
+    free(writer->candidates[1]);
+    free(writer);
+    return failed;
+}
+
+int pngWriterDetach(PngWriter* writer, unsigned* adler, long* length) {
+    writer->detached = 1;
+    finishBand(writer, 1);
+    *adler = writer->adler;
+    *length = writer->length;
+    return freeWriter(writer);
+}
+
+int pngWriterClose(PngWriter* writer) {
+    if (writer->rowCount != writer->height) {
+        writer->failed = 1;
+        // Les bandes déjà soumises au pool ne doivent pas être libérées pendant leur compression
+        if (writer->bandCount > 1 && writer->current > 0) waitTasks(writer->pool);
+    } else {
+        finishBand(writer, 1);
+        endChunk(writer, beginChunk(writer, "IEND", 0));
+    }
+    return freeWriter(writer);
+}
@@ -0,0 +1,67 @@
+#ifndef PNGWRITE_H
+#define PNGWRITE_H
+
+/*\
+ * Écriture d'un png ligne par ligne, sans garder l'image en mémoire.
+ * Les lignes sont filtrées (par défaut avec le filtre qui donne la plus petite somme des différences,
+ * comme stb_image_write; voir pngWriterSetFilters) et rassemblées en bandes d'environ 256 Ko. Chaque bande est compressée (voir deflateChunk)
+ * puis écrite dans son propre chunk IDAT.
+ *
+ * Avec un pool de plusieurs threads, les bandes sont compressées sur le pool pendant que les lignes suivantes
+ * arrivent, et écrites dans l'ordre. Le pool ne doit pas être celui qui exécute l'écriture.
+\*/
+
+#include <stdio.h>
+
+#include "pool.h"
+#include "deflate.h"
+
+typedef struct PngWriter PngWriter;
+
+/*\
+ * Les tables de compression des bandes (plusieurs centaines de Ko chacune), prêtées aux PngWriter
+ * successifs d'un même thread pour ne pas les allouer à chaque png: un PngWriter à la fois.
+ * Une structure à 0 est vide; les tables sont ajoutées au besoin par pngWriterOpen.
+\*/
+typedef struct {
+    DeflateTables** tables;
+    int count;
+} PngTables;
+
+// Libère les tables gardées
+void pngTablesFree(PngTables* tables);
+
+// Les filtres essayés sur chaque ligne
+typedef enum {
+    PNG_FILTERS_ALL,    // les 5 filtres: celui qui donne la plus petite somme des différences est gardé (par défaut)
+    PNG_FILTERS_UP_SUB, // seulement Up et Sub, avec la même heuristique: plus rapide
+    PNG_FILTERS_PAETH,  // Paeth sur toutes les lignes, sans heuristique
+    PNG_FILTERS_NONE,   // pas de filtre: le plus rapide, mais le png est plus gros
+} PngFilters;
+
+/*\
+ * Écrit l'en-tête d'un png de width x height pixels à channels composants (1 à 4) dans file, avec les tables
+ * de compression de tables (jusqu'à ce que writer soit libéré). Renvoie NULL en cas d'erreur
+\*/
+PngWriter* pngWriterOpen(FILE* file, int width, int height, int channels, int level, ThreadPool* pool, PngTables* tables);
+
+// Choisit les filtres essayés sur les lignes suivantes
+void pngWriterSetFilters(PngWriter* writer, PngFilters filters);
+
+// Ajoute la ligne suivante de l'image (width * channels bytes). Renvoie 0 si tout s'est bien passé
+int pngWriterAddRow(PngWriter* writer, const unsigned char* row);
+
+// Écrit la fin du png (toutes les lignes doivent avoir été ajoutées) et libère writer. Renvoie 0 si tout s'est bien passé
+int pngWriterClose(PngWriter* writer);
+
+/*\
+ * Pour continuer avec la fin du flux zlib d'un autre png (voir pngsplice.h): pngWriterAddFiltered ajoute des données
+ * déjà filtrées (length bytes, pas forcément des lignes entières; plus aucune ligne ne peut être ajoutée ensuite),
+ * et pngWriterDetach écrit les bandes qui restent sans terminer le flux zlib ni le png: il finit sur un byte entier.
+ * pngWriterDetach renvoie l'Adler-32 et la taille de toutes les données ajoutées dans adler et length, et libère writer.
+ * Renvoient 0 si tout s'est bien passé.
+\*/
+int pngWriterAddFiltered(PngWriter* writer, const unsigned char* data, long length);
+int pngWriterDetach(PngWriter* writer, unsigned* adler, long* length);
+
+#endif
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+typedef struct TaskNode {
+    Task task;
+    void* arg;
+    TaskGroup* group; // NULL: la tâche n'appartient à aucun groupe
+    struct TaskNode* next;
+} TaskNode;
+
+struct ThreadPool {
+    pthread_t* threads;
+    int threadCount;
+
+    pthread_mutex_t lock;
+    pthread_cond_t taskAvailable; // signalé quand une tâche est ajoutée (ou à l'arrêt du pool)
+    pthread_cond_t tasksDone;     // signalé quand il n'y a plus de tâche en attente ni en cours (ou plus dans un groupe)
+    TaskNode* first;
+    TaskNode* last;
+    int pendingTasks; // les tâches en attente + celles en cours d'exécution
+    int stopping;
+};
+
+int coreCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+}
+
+static void* worker(void* arg) {
+    ThreadPool* pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->first == NULL && !pool->stopping) {
+            pthread_cond_wait(&pool->taskAvailable, &pool->lock);
+        }
+        if (pool->first == NULL) break; // le pool s'arrête et la file est vide
+
+        TaskNode* node = pool->first;
+        pool->first = node->next;
+        if (pool->first == NULL) pool->last = NULL;
+
+        pthread_mutex_unlock(&pool->lock);
+        node->task(node->arg);
+        TaskGroup* group = node->group;
+        free(node);
+        pthread_mutex_lock(&pool->lock);
+
+        pool->pendingTasks--;
+        if (group != NULL) group->pending--;
+        if (pool->pendingTasks == 0 || (group != NULL && group->pending == 0)) pthread_cond_broadcast(&pool->tasksDone);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+ThreadPool* createThreadPool(int threadCount) {
+    if (threadCount <= 0) threadCount = coreCount();
+
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    pool->threads = malloc(threadCount * sizeof(pthread_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->taskAvailable, NULL);
+    pthread_cond_init(&pool->tasksDone, NULL);
+
+    for (int i = 0; i < threadCount; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker, pool) != 0) break;
+        pool->threadCount++;
+    }
+
+    if (pool->threadCount == 0) {
+        destroyThreadPool(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void destroyThreadPool(ThreadPool* pool) {
+    if (pool == NULL) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->taskAvailable);
+    pthread_mutex_unlock(&pool->lock);
+
+    // Les threads terminent les tâches restantes avant de s'arrêter
+    for (int i = 0; i < pool->threadCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->taskAvailable);
+    pthread_cond_destroy(&pool->tasksDone);
+    free(pool->threads);
+    free(pool);
+}
+
+int threadPoolSize(const ThreadPool* pool) {
+    return pool == NULL ? 1 : pool->threadCount;
+}
+
+void submitGroupTask(ThreadPool* pool, TaskGroup* group, Task task, void* arg) {
+    // Sans pool, la tâche est exécutée tout de suite par le thread appelant
+    if (pool == NULL) {
+        task(arg);
+        return;
+    }
+
+    TaskNode* node = malloc(sizeof(TaskNode));
+    node->task = task;
+    node->arg = arg;
+    node->group = group;
+    node->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (group != NULL) group->pending++;
+    if (pool->last == NULL) pool->first = node;
+    else pool->last->next = node;
+    pool->last = node;
+    pool->pendingTasks++;
+    pthread_cond_signal(&pool->taskAvailable);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void submitTask(ThreadPool* pool, Task task, void* arg) {
+    submitGroupTask(pool, NULL, task, arg);
+}
+
+void waitTaskGroup(ThreadPool* pool, TaskGroup* group) {
+    if (pool == NULL) return;
+
+    pthread_mutex_lock(&pool->lock);
+    while (group->pending > 0) {
+        pthread_cond_wait(&pool->tasksDone, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void waitTasks(ThreadPool* pool) {
+    if (pool == NULL) return;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pendingTasks > 0) {
+        pthread_cond_wait(&pool->tasksDone, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,36 @@
+#ifndef POOL_H
+#define POOL_H
+
+/*\
+ * Un pool de threads tout simple: une file de tâches partagée par des threads qui tournent
+ * pendant toute la vie du pool. waitTasks attend que toutes les tâches soumises soient terminées.
+\*/
+
+typedef struct ThreadPool ThreadPool;
+
+typedef void (*Task)(void* arg);
+
+// threadCount = 0: un thread par cœur du processeur
+ThreadPool* createThreadPool(int threadCount);
+void destroyThreadPool(ThreadPool* pool);
+
+int threadPoolSize(const ThreadPool* pool);
+
+void submitTask(ThreadPool* pool, Task task, void* arg);
+void waitTasks(ThreadPool* pool);
+
+/*\
+ * Un groupe de tâches attendues ensemble, sans attendre les autres tâches du pool (par exemple les bandes
+ * du png compressées en même temps). Un groupe à 0 est vide. Sans pool, les tâches sont exécutées tout de suite.
+\*/
+typedef struct {
+    int pending;
+} TaskGroup;
+
+void submitGroupTask(ThreadPool* pool, TaskGroup* group, Task task, void* arg);
+void waitTaskGroup(ThreadPool* pool, TaskGroup* group);
+
+// Le nombre de cœurs disponibles
+int coreCount(void);
+
+#endif
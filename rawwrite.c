@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "rawwrite.h"
+
+typedef unsigned char uchar;
+
+struct RawWriter {
+    FILE* file;
+    RawFormat format;
+    int width, height;
+    int rowCount;  // les lignes déjà ajoutées
+    int headerLength;
+    long rowBytes; // la taille d'une ligne dans le fichier (avec le remplissage jusqu'à un multiple de 4 en BMP)
+    uchar* row;    // la ligne convertie en BGR (BMP et TGA)
+    int failed;
+};
+
+int rawFormatFromPath(const char* path, RawFormat* format) {
+    static const char* extensions[] = { [RAW_FORMAT_BMP] = ".bmp", [RAW_FORMAT_TGA] = ".tga", [RAW_FORMAT_PPM] = ".ppm" };
+    const size_t length = strlen(path);
+    for (int i = 0; i < 3; i++) {
+        if (length >= 4 && strcasecmp(path + length - 4, extensions[i]) == 0) {
+            *format = i;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void putUint16Le(uchar* out, unsigned value) {
+    out[0] = value;
+    out[1] = value >> 8;
+}
+
+static void putUint32Le(uchar* out, unsigned value) {
+    putUint16Le(out, value);
+    putUint16Le(out + 2, value >> 16);
+}
+
+// Écrit l'en-tête du format dans header; renvoie sa taille, ou 0 si le format ne permet pas cette taille d'image
+static int writeHeader(const RawWriter* writer, uchar* header) {
+    const int width = writer->width, height = writer->height;
+    switch (writer->format) {
+        case RAW_FORMAT_BMP: {
+            const long fileSize = 14 + 40 + writer->rowBytes * height;
+            if (fileSize > 0xffffffffL) return 0;
+            memset(header, 0, 54);
+            header[0] = 'B';
+            header[1] = 'M';
+            putUint32Le(header + 2, fileSize);
+            putUint32Le(header + 10, 14 + 40); // début des pixels
+            putUint32Le(header + 14, 40);      // taille de BITMAPINFOHEADER
+            putUint32Le(header + 18, width);
+            putUint32Le(header + 22, height);  // positive: les lignes vont de bas en haut
+            putUint16Le(header + 26, 1);       // plans
+            putUint16Le(header + 28, 24);      // bits par pixel, sans compression
+            return 54;
+        }
+        case RAW_FORMAT_TGA:
+            if (width > 0xffff || height > 0xffff) return 0;
+            memset(header, 0, 18);
+            header[2] = 2; // couleurs vraies, sans compression
+            putUint16Le(header + 12, width);
+            putUint16Le(header + 14, height);
+            header[16] = 24;   // bits par pixel
+            header[17] = 0x20; // origine en haut à gauche
+            return 18;
+        case RAW_FORMAT_PPM:
+            return sprintf((char*) header, "P6\n%d %d\n255\n", width, height);
+    }
+    return 0;
+}
+
+RawWriter* rawWriterOpen(FILE* file, int width, int height, RawFormat format) {
+    if (width <= 0 || height <= 0) return NULL;
+
+    RawWriter* writer = calloc(1, sizeof(RawWriter));
+    if (writer == NULL) return NULL;
+    writer->file = file;
+    writer->format = format;
+    writer->width = width;
+    writer->height = height;
+    writer->rowBytes = (long) width * 3;
+    if (format == RAW_FORMAT_BMP) writer->rowBytes = (writer->rowBytes + 3) & ~3L;
+
+    uchar header[64];
+    const int headerLength = writer->headerLength = writeHeader(writer, header);
+    // En PPM, les lignes sont écrites telles quelles: pas besoin de ligne convertie
+    if (format != RAW_FORMAT_PPM) writer->row = calloc(writer->rowBytes, 1);
+    if (headerLength == 0 || (format != RAW_FORMAT_PPM && writer->row == NULL)
+        || fwrite(header, 1, headerLength, file) != (size_t) headerLength) {
+        free(writer->row);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int rawWriterAddRow(RawWriter* writer, const unsigned char* row) {
+    if (writer->rowCount == writer->height) return 1;
+
+    const uchar* out = row;
+    if (writer->format != RAW_FORMAT_PPM) {
+        // RGB vers BGR (le remplissage de fin de ligne reste à 0)
+        uchar* bgr = writer->row;
+        for (long i = 0; i < (long) writer->width * 3; i += 3) {
+            bgr[i] = row[i + 2];
+            bgr[i + 1] = row[i + 1];
+            bgr[i + 2] = row[i];
+        }
+        out = bgr;
+    }
+    // La ligne y d'un BMP est la (height - 1 - y)ème du fichier
+    const int y = writer->rowCount;
+    if (writer->format == RAW_FORMAT_BMP
+        && fseeko(writer->file, writer->headerLength + (writer->height - 1 - y) * writer->rowBytes, SEEK_SET) != 0) {
+        writer->failed = 1;
+    }
+    if (!writer->failed && fwrite(out, 1, writer->rowBytes, writer->file) != (size_t) writer->rowBytes) writer->failed = 1;
+    writer->rowCount++;
+    return writer->failed;
+}
+
+int rawWriterClose(RawWriter* writer) {
+    const int failed = writer->failed || writer->rowCount != writer->height;
+    free(writer->row);
+    free(writer);
+    return failed;
+}
@@ -0,0 +1,41 @@
+#ifndef RAWWRITE_H
+#define RAWWRITE_H
+
+/*\
+ * Écriture d'une image sans compression (BMP, TGA ou PPM) ligne par ligne, sans garder l'image en mémoire,
+ * pour les tâches où le format de sortie est libre: chaque ligne est écrite telle quelle (en BGR pour BMP et TGA).
+ *
+ * Les fichiers sont ceux de stbi_write_bmp et stbi_write_tga (sans RLE). Les lignes d'un BMP sont rangées de bas en haut:
+ * chacune est écrite à sa place avec fseek, la sortie doit donc être un fichier. En TGA, l'origine est en haut à gauche
+ * pour que les lignes soient écrites dans l'ordre (stbi_write_tga les range de bas en haut).
+\*/
+
+#include <stdio.h>
+
+typedef struct RawWriter RawWriter;
+
+typedef enum {
+    RAW_FORMAT_BMP,
+    RAW_FORMAT_TGA,
+    RAW_FORMAT_PPM,
+} RawFormat;
+
+/*\
+ * Le format d'après l'extension de path (.bmp, .tga, .ppm, sans tenir compte de la casse).
+ * Renvoie 0 et le format dans format, ou 1 si l'extension n'est pas celle d'un de ces formats.
+\*/
+int rawFormatFromPath(const char* path, RawFormat* format);
+
+/*\
+ * Écrit l'en-tête d'une image de width x height pixels à 3 composants (RGB) dans file.
+ * Renvoie NULL si la mémoire manque ou si le format ne permet pas cette taille (65535 pixels de côté en TGA, 4 Go en BMP).
+\*/
+RawWriter* rawWriterOpen(FILE* file, int width, int height, RawFormat format);
+
+// Ajoute la ligne suivante de l'image (width * 3 bytes, en RGB). Renvoie 0 si tout s'est bien passé
+int rawWriterAddRow(RawWriter* writer, const unsigned char* row);
+
+// Vérifie que toutes les lignes ont été ajoutées et libère writer. Renvoie 0 si tout s'est bien passé
+int rawWriterClose(RawWriter* writer);
+
+#endif
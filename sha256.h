@@ -0,0 +1,14 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+/*\
+ * SHA-256 (FIPS 180-4), pour nommer les entrées du cache d'après le contenu des images: contrairement
+ * au CRC-32 et à l'Adler-32, deux fichiers différents n'ont en pratique jamais la même empreinte.
+\*/
+
+#define SHA256_LENGTH 32
+
+// L'empreinte des length bytes de data, écrite dans digest
+void sha256(const unsigned char* data, long length, unsigned char digest[SHA256_LENGTH]);
+
+#endif